@@ -0,0 +1,147 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+// Benchmark of Exodus metadata writes for meshes with many groups
+//
+// Builds a strip of quads where every quad is its own block and its bottom
+// edge its own boundary, as left by meshers that give each region and
+// surface a physical group. The file is then written once defining every
+// block and set with its own calls, the way the writer used to, and once
+// with msh2exo::write_mesh, which defines all of them with one
+// ex_put_block_params, one ex_put_sets and one ex_put_names per kind.
+//
+// usage: bench_exodus_metadata [n_groups] [output.exo]
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <exodusII.h>
+}
+
+#include "exodus_writer.hpp"
+#include "intermediate_mesh.hpp"
+#include "options.hpp"
+
+template <typename F> static double seconds(F &&func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+static msh2exo::IntermediateMesh strip_mesh(int n_groups) {
+  msh2exo::IntermediateMesh imesh;
+  imesh.dim = 2;
+  imesh.n_nodes = 2 * (n_groups + 1);
+  imesh.n_elements = n_groups;
+  imesh.n_blocks = n_groups;
+  imesh.coords.resize(imesh.n_nodes * 3);
+  for (int i = 0; i <= n_groups; i++) {
+    for (int row = 0; row < 2; row++) {
+      auto *xyz = imesh.coords.data() + (row * (n_groups + 1) + i) * 3;
+      xyz[0] = i;
+      xyz[1] = row;
+      xyz[2] = 0;
+    }
+  }
+  for (int i = 0; i < n_groups; i++) {
+    msh2exo::IntermediateMesh::block block;
+    block.name = fmt::format("region_{}", i);
+    block.n_elements = 1;
+    block.type = msh2exo::element_type::quad4;
+    block.connectivity.resize(4);
+    block.connectivity[0] = i;
+    block.connectivity[1] = i + 1;
+    block.connectivity[2] = n_groups + 2 + i;
+    block.connectivity[3] = n_groups + 1 + i;
+    imesh.blocks.push_back(std::move(block));
+
+    msh2exo::boundary bound;
+    bound.tag = i + 1;
+    bound.name = fmt::format("surface_{}", i);
+    bound.nodes = {i, i + 1};
+    bound.side_elems = {i};
+    bound.side_ids = {0};
+    imesh.boundaries.push_back(std::move(bound));
+  }
+  return imesh;
+}
+
+// one define call per block and set, each followed by its name and data
+static void write_per_entity(const msh2exo::IntermediateMesh &imesh,
+                             const std::string &output) {
+  int cpu_size = sizeof(double);
+  int io_size = sizeof(double);
+  int exoid = ex_create(output.c_str(), EX_CLOBBER, &cpu_size, &io_size);
+  if (exoid < 0) {
+    fmt::print(stderr, "could not create {}\n", output);
+    std::exit(1);
+  }
+  ex_put_init(exoid, "", imesh.dim, imesh.n_nodes, imesh.n_elements,
+              imesh.n_blocks, imesh.boundaries.size(),
+              imesh.boundaries.size());
+  for (int i = 0; i < imesh.n_blocks; i++) {
+    const auto &block = imesh.blocks[i];
+    std::vector<int> conn(block.connectivity.begin(),
+                          block.connectivity.end());
+    for (auto &node : conn) {
+      node++;
+    }
+    ex_put_block(exoid, EX_ELEM_BLOCK, i + 1, "QUAD4", block.n_elements, 4, 0,
+                 0, 0);
+    ex_put_name(exoid, EX_ELEM_BLOCK, i + 1, block.name.c_str());
+    ex_put_conn(exoid, EX_ELEM_BLOCK, i + 1, conn.data(), NULL, NULL);
+  }
+  std::vector<double> x(imesh.n_nodes);
+  std::vector<double> y(imesh.n_nodes);
+  for (int64_t i = 0; i < imesh.n_nodes; i++) {
+    x[i] = imesh.coords[i * 3];
+    y[i] = imesh.coords[i * 3 + 1];
+  }
+  ex_put_coord(exoid, x.data(), y.data(), NULL);
+  for (const auto &bound : imesh.boundaries) {
+    std::vector<int> nodes(bound.nodes.begin(), bound.nodes.end());
+    for (auto &node : nodes) {
+      node++;
+    }
+    ex_put_set_param(exoid, EX_NODE_SET, bound.tag, nodes.size(), 0);
+    ex_put_set(exoid, EX_NODE_SET, bound.tag, nodes.data(), NULL);
+    ex_put_name(exoid, EX_NODE_SET, bound.tag, bound.name.c_str());
+  }
+  for (const auto &bound : imesh.boundaries) {
+    std::vector<int> elems;
+    std::vector<int> sides;
+    for (size_t k = 0; k < bound.side_elems.size(); k++) {
+      elems.push_back(bound.side_elems[k] + 1);
+      sides.push_back(bound.side_ids[k] + 1);
+    }
+    ex_put_set_param(exoid, EX_SIDE_SET, bound.tag, sides.size(), 0);
+    ex_put_set(exoid, EX_SIDE_SET, bound.tag, elems.data(), sides.data());
+    ex_put_name(exoid, EX_SIDE_SET, bound.tag, bound.name.c_str());
+  }
+  ex_close(exoid);
+}
+
+int main(int argc, char **argv) {
+  int n_groups = argc > 1 ? std::atoi(argv[1]) : 5000;
+  std::string output = argc > 2 ? argv[2] : "bench_exodus_metadata.exo";
+
+  auto imesh = strip_mesh(n_groups);
+  msh2exo::Options options;
+  fmt::print("{} blocks, {} node sets, {} side sets\n", n_groups, n_groups,
+             n_groups);
+  double per_entity = seconds([&] { write_per_entity(imesh, output); });
+  fmt::print("per entity {:8.3f} s\n", per_entity);
+  double bulk = seconds([&] { msh2exo::write_mesh(imesh, output, options); });
+  fmt::print("bulk       {:8.3f} s ({:.1f}x)\n", bulk, per_entity / bulk);
+  return 0;
+}
@@ -0,0 +1,85 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+// Benchmark of mesh_vector against std::vector for connectivity sized arrays
+//
+// Times the allocation and fill of an int64 array the way a reader does it,
+// then repeated parallel remap passes the way node merging and the writer
+// walk connectivity. With std::vector the pages are first touched by the
+// value initialization on the calling thread, with mesh_vector by the
+// parallel threads in their own chunks on huge pages where available.
+//
+// usage: bench_mesh_alloc [n_entries] [n_threads]
+// (the default of 1e9 entries needs 8 GB)
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "mesh_allocator.hpp"
+#include "parallel.hpp"
+
+template <typename F> static double seconds(F &&func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// AnonHugePages of the process in kB, -1 where unavailable
+static int64_t anon_huge_pages_kb() {
+  std::ifstream smaps("/proc/self/smaps_rollup");
+  std::string key;
+  int64_t value;
+  while (smaps >> key >> value) {
+    if (key == "AnonHugePages:") {
+      return value;
+    }
+    smaps.ignore(1 << 10, '\n');
+  }
+  return -1;
+}
+
+template <typename V> static void run(const char *what, int64_t n_entries) {
+  const int n_passes = 5;
+  V conn;
+  double fill_time = seconds([&] {
+    conn.resize(n_entries);
+    msh2exo::parallel_for(0, n_entries,
+                          [&](int64_t i) { conn[i] = i % 1000003; });
+  });
+  int64_t huge_kb = anon_huge_pages_kb();
+  double remap_time = seconds([&] {
+    for (int pass = 0; pass < n_passes; pass++) {
+      msh2exo::parallel_for(0, n_entries,
+                            [&](int64_t i) { conn[i] = conn[i] * 3 + 1; });
+    }
+  });
+  // read and written once per pass
+  double bytes = 2.0 * n_passes * n_entries * sizeof(int64_t);
+  fmt::print("{:12} allocate+fill {:7.3f} s | remap {:7.3f} s/pass {:7.2f} "
+             "GB/s | huge pages {}\n",
+             what, fill_time, remap_time / n_passes, bytes / remap_time / 1e9,
+             huge_kb < 0 ? std::string("n/a")
+                         : fmt::format("{} MB", huge_kb / 1024));
+}
+
+int main(int argc, char **argv) {
+  int64_t n_entries =
+      argc > 1 ? std::strtoll(argv[1], nullptr, 10) : 1000000000;
+  msh2exo::set_thread_count(argc > 2 ? std::atoi(argv[2]) : 0);
+
+  fmt::print("{} int64 entries, {} threads\n", n_entries,
+             msh2exo::thread_count());
+  run<std::vector<int64_t>>("std::vector", n_entries);
+  run<msh2exo::mesh_vector<int64_t>>("mesh_vector", n_entries);
+  return 0;
+}
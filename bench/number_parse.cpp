@@ -0,0 +1,106 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+// Microbenchmark of the builtin reader number kernels against operator>>
+//
+// Formats node tags and coordinates the way Gmsh writes them, parses them
+// back both ways and checks that the coordinates are bit identical.
+//
+// usage: bench_number_parse [n_values]
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fmt/format.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "text_scanner.hpp"
+
+template <typename F> static double seconds(F &&func) {
+  auto start = std::chrono::steady_clock::now();
+  func();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+int main(int argc, char **argv) {
+  size_t n_values = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 5000000;
+
+  std::mt19937_64 rng(42);
+  std::uniform_real_distribution<double> coord(-1000.0, 1000.0);
+  std::uniform_int_distribution<int> exponent(-30, 30);
+  std::uniform_int_distribution<uint64_t> tag(1, 1ull << 40);
+
+  std::string doubles_text;
+  std::string ints_text;
+  std::vector<double> expected(n_values);
+  for (size_t i = 0; i < n_values; i++) {
+    double val = coord(rng);
+    // a share of values far from unity to exercise the slow path
+    if (i % 16 == 0) {
+      val *= std::pow(10.0, exponent(rng));
+    }
+    doubles_text += fmt::format("{:.16g}{}", val, i % 3 == 2 ? '\n' : ' ');
+    ints_text += fmt::format("{}\n", tag(rng));
+  }
+
+  std::vector<double> stream_doubles(n_values);
+  std::vector<double> kernel_doubles(n_values);
+  std::vector<uint64_t> stream_ints(n_values);
+  std::vector<uint64_t> kernel_ints(n_values);
+
+  double stream_double_time = seconds([&] {
+    std::istringstream in(doubles_text);
+    for (auto &val : stream_doubles) {
+      in >> val;
+    }
+  });
+  double kernel_double_time = seconds([&] {
+    msh2exo::text_scanner in(doubles_text.data(), doubles_text.size());
+    for (auto &val : kernel_doubles) {
+      in >> val;
+    }
+  });
+  double stream_int_time = seconds([&] {
+    std::istringstream in(ints_text);
+    for (auto &val : stream_ints) {
+      in >> val;
+    }
+  });
+  double kernel_int_time = seconds([&] {
+    msh2exo::text_scanner in(ints_text.data(), ints_text.size());
+    for (auto &val : kernel_ints) {
+      in >> val;
+    }
+  });
+
+  bool doubles_match =
+      std::memcmp(stream_doubles.data(), kernel_doubles.data(),
+                  n_values * sizeof(double)) == 0;
+  bool ints_match = stream_ints == kernel_ints;
+
+  auto report = [&](const char *what, double stream_time, double kernel_time,
+                    size_t bytes) {
+    fmt::print("{:8} operator>> {:8.1f} ns/value {:7.1f} MB/s | kernel "
+               "{:6.1f} ns/value {:7.1f} MB/s | speedup {:.1f}x\n",
+               what, 1e9 * stream_time / n_values, bytes / stream_time / 1e6,
+               1e9 * kernel_time / n_values, bytes / kernel_time / 1e6,
+               stream_time / kernel_time);
+  };
+  report("double", stream_double_time, kernel_double_time,
+         doubles_text.size());
+  report("integer", stream_int_time, kernel_int_time, ints_text.size());
+
+  fmt::print("doubles bit identical: {}\nintegers identical: {}\n",
+             doubles_match ? "yes" : "NO", ints_match ? "yes" : "NO");
+  return doubles_match && ints_match ? 0 : 1;
+}
@@ -0,0 +1,482 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+// Differential harness of the builtin and Gmsh SDK readers
+//
+// Reads every mesh with read_gmsh_file and read_gmsh_sdk_file, compares the
+// two meshes in a numbering invariant form (nodes and elements by gmsh tag,
+// blocks by name, boundaries by tag) and reports the read time and peak
+// heap of each reader side by side. Without arguments a corpus of box
+// meshes is generated in the working directory.
+//
+// usage: bench_reader_diff [mesh.msh ...]
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/format.h>
+#include <map>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gmsh_reader.hpp"
+#include "intermediate_mesh.hpp"
+#include "mesh_allocator.hpp"
+
+// heap accounting: every allocation carries its size in a header so the
+// bytes live during each reader call can be tracked, Gmsh included. The
+// huge page mesh arrays bypass operator new and are counted through the
+// mesh allocation hook.
+static std::atomic<int64_t> heap_bytes(0);
+static std::atomic<int64_t> heap_peak(0);
+static const size_t header_size = 16;
+
+static void count_bytes(int64_t size) {
+  auto bytes = heap_bytes.fetch_add(size) + size;
+  auto peak = heap_peak.load();
+  while (bytes > peak && !heap_peak.compare_exchange_weak(peak, bytes)) {
+  }
+}
+
+static void *counted_alloc(size_t size) {
+  auto *block = static_cast<char *>(std::malloc(size + header_size));
+  if (block == nullptr) {
+    return nullptr;
+  }
+  *reinterpret_cast<size_t *>(block) = size;
+  count_bytes(static_cast<int64_t>(size));
+  return block + header_size;
+}
+
+static void counted_free(void *ptr) {
+  if (ptr == nullptr) {
+    return;
+  }
+  auto *block = static_cast<char *>(ptr) - header_size;
+  heap_bytes.fetch_sub(*reinterpret_cast<size_t *>(block));
+  std::free(block);
+}
+
+void *operator new(size_t size) {
+  void *ptr = counted_alloc(size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  return counted_alloc(size);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+  return counted_alloc(size);
+}
+void operator delete(void *ptr) noexcept { counted_free(ptr); }
+void operator delete[](void *ptr) noexcept { counted_free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { counted_free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { counted_free(ptr); }
+void operator delete(void *ptr, const std::nothrow_t &) noexcept {
+  counted_free(ptr);
+}
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept {
+  counted_free(ptr);
+}
+
+struct read_result {
+  msh2exo::IntermediateMesh mesh;
+  std::string error;
+  double seconds = 0;
+  int64_t peak_bytes = 0;
+};
+
+template <typename F> static read_result timed_read(F &&read) {
+  read_result result;
+  heap_peak = heap_bytes.load();
+  auto heap_before = heap_bytes.load();
+  auto start = std::chrono::steady_clock::now();
+  try {
+    result.mesh = read();
+  } catch (const std::exception &e) {
+    result.error = e.what();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  result.seconds = elapsed.count();
+  result.peak_bytes = heap_peak - heap_before;
+  return result;
+}
+
+struct canonical_block {
+  std::string name;
+  msh2exo::element_type type;
+  // rows of element tag followed by the node tags, sorted
+  std::vector<std::vector<int64_t>> elements;
+};
+
+struct canonical_set {
+  int tag;
+  std::string name;
+  std::vector<int64_t> node_tags;
+};
+
+struct canonical_mesh {
+  int64_t dim;
+  // (tag, coordinates) of the nodes used by elements, sorted by tag
+  std::vector<std::pair<int64_t, std::array<double, 3>>> nodes;
+  std::vector<canonical_block> blocks;
+  std::vector<canonical_set> sets;
+};
+
+static canonical_mesh canonicalize(const msh2exo::IntermediateMesh &imesh) {
+  auto node_tag = [&](int64_t node) {
+    return imesh.node_tags.empty() ? node : imesh.node_tags[node];
+  };
+
+  canonical_mesh mesh;
+  mesh.dim = imesh.dim;
+  std::vector<bool> used(imesh.n_nodes, false);
+  int64_t elem = 0;
+  for (const auto &block : imesh.blocks) {
+    canonical_block cblock;
+    cblock.name = block.name;
+    cblock.type = block.type;
+    int n_nodes = msh2exo::elem_info_map.at(block.type).n_nodes;
+    for (int64_t j = 0; j < block.n_elements; j++, elem++) {
+      std::vector<int64_t> row;
+      row.push_back(imesh.elem_tags.empty() ? elem : imesh.elem_tags[elem]);
+      for (int k = 0; k < n_nodes; k++) {
+        auto node = block.connectivity[j * n_nodes + k];
+        used[node] = true;
+        row.push_back(node_tag(node));
+      }
+      cblock.elements.push_back(std::move(row));
+    }
+    std::sort(cblock.elements.begin(), cblock.elements.end());
+    mesh.blocks.push_back(std::move(cblock));
+  }
+  std::sort(mesh.blocks.begin(), mesh.blocks.end(),
+            [](const auto &a, const auto &b) { return a.name < b.name; });
+
+  for (int64_t i = 0; i < imesh.n_nodes; i++) {
+    if (used[i]) {
+      mesh.nodes.push_back({node_tag(i),
+                            {imesh.coords[i * 3], imesh.coords[i * 3 + 1],
+                             imesh.coords[i * 3 + 2]}});
+    }
+  }
+  std::sort(mesh.nodes.begin(), mesh.nodes.end());
+
+  for (const auto &bound : imesh.boundaries) {
+    canonical_set set{bound.tag, bound.name, {}};
+    for (auto node : bound.nodes) {
+      set.node_tags.push_back(node_tag(node));
+    }
+    std::sort(set.node_tags.begin(), set.node_tags.end());
+    mesh.sets.push_back(std::move(set));
+  }
+  std::sort(mesh.sets.begin(), mesh.sets.end(),
+            [](const auto &a, const auto &b) { return a.tag < b.tag; });
+  return mesh;
+}
+
+// differences between the canonical meshes, at most a few per kind
+static std::vector<std::string> compare(const canonical_mesh &a,
+                                        const canonical_mesh &b) {
+  std::vector<std::string> diffs;
+  if (a.dim != b.dim) {
+    diffs.push_back(fmt::format("dimension {} vs {}", a.dim, b.dim));
+  }
+
+  if (a.nodes.size() != b.nodes.size()) {
+    diffs.push_back(fmt::format("{} vs {} nodes in elements", a.nodes.size(),
+                                b.nodes.size()));
+  } else {
+    for (size_t i = 0; i < a.nodes.size(); i++) {
+      if (a.nodes[i] != b.nodes[i]) {
+        diffs.push_back(fmt::format(
+            "node tag {}: ({}, {}, {}) vs tag {}: ({}, {}, {})",
+            a.nodes[i].first, a.nodes[i].second[0], a.nodes[i].second[1],
+            a.nodes[i].second[2], b.nodes[i].first, b.nodes[i].second[0],
+            b.nodes[i].second[1], b.nodes[i].second[2]));
+        break;
+      }
+    }
+  }
+
+  if (a.blocks.size() != b.blocks.size()) {
+    diffs.push_back(
+        fmt::format("{} vs {} blocks", a.blocks.size(), b.blocks.size()));
+  } else {
+    for (size_t i = 0; i < a.blocks.size(); i++) {
+      const auto &ba = a.blocks[i];
+      const auto &bb = b.blocks[i];
+      if (ba.name != bb.name || ba.type != bb.type) {
+        diffs.push_back(fmt::format("block '{}' (type {}) vs '{}' (type {})",
+                                    ba.name, static_cast<int>(ba.type),
+                                    bb.name, static_cast<int>(bb.type)));
+      } else if (ba.elements != bb.elements) {
+        diffs.push_back(fmt::format("block '{}': {} vs {} elements, "
+                                    "connectivity differs",
+                                    ba.name, ba.elements.size(),
+                                    bb.elements.size()));
+      }
+    }
+  }
+
+  if (a.sets.size() != b.sets.size()) {
+    diffs.push_back(
+        fmt::format("{} vs {} boundaries", a.sets.size(), b.sets.size()));
+  } else {
+    for (size_t i = 0; i < a.sets.size(); i++) {
+      const auto &sa = a.sets[i];
+      const auto &sb = b.sets[i];
+      if (sa.tag != sb.tag || sa.name != sb.name) {
+        diffs.push_back(fmt::format("boundary '{}' (tag {}) vs '{}' (tag {})",
+                                    sa.name, sa.tag, sb.name, sb.tag));
+      } else if (sa.node_tags != sb.node_tags) {
+        diffs.push_back(fmt::format("boundary '{}': {} vs {} nodes", sa.name,
+                                    sa.node_tags.size(),
+                                    sb.node_tags.size()));
+      }
+    }
+  }
+  return diffs;
+}
+
+// Structured box mesh of kind hex, tet, quad or tri with n cells per
+// direction, split into n_blocks blocks along x, and left, right and bottom
+// boundaries. Node tags are sparse and out of order to exercise the tag
+// mapping of both readers.
+static void write_box_mesh(const std::string &path, const std::string &kind,
+                           int n, int n_blocks) {
+  const bool solid = kind == "hex" || kind == "tet";
+  const int dim = solid ? 3 : 2;
+  const int nz = solid ? n : 0;
+  auto node_id = [&](int i, int j, int k) {
+    int64_t index = i + (n + 1) * (j + static_cast<int64_t>(n + 1) * k);
+    return 7 + 3 * index;
+  };
+
+  std::FILE *out = std::fopen(path.c_str(), "w");
+  if (out == nullptr) {
+    throw std::runtime_error("could not write " + path);
+  }
+  fmt::print(out, "$MeshFormat\n4.1 0 8\n$EndMeshFormat\n");
+
+  const char *boundary_names[] = {"left", "right", "bottom"};
+  fmt::print(out, "$PhysicalNames\n{}\n", 3 + n_blocks);
+  for (int b = 0; b < 3; b++) {
+    fmt::print(out, "{} {} \"{}\"\n", dim - 1, b + 1, boundary_names[b]);
+  }
+  for (int b = 0; b < n_blocks; b++) {
+    fmt::print(out, "{} {} \"{}\"\n", dim, 10 + b,
+               n_blocks == 1 ? "domain" : fmt::format("block {}", b + 1));
+  }
+  fmt::print(out, "$EndPhysicalNames\n");
+
+  std::array<int, 4> n_entities = {0, 0, 0, 0};
+  n_entities[dim - 1] = 3;
+  n_entities[dim] = n_blocks;
+  fmt::print(out, "$Entities\n{} {} {} {}\n", n_entities[0], n_entities[1],
+             n_entities[2], n_entities[3]);
+  for (int b = 0; b < 3; b++) {
+    fmt::print(out, "{} 0 0 0 1 1 1 1 {} 0\n", b + 1, b + 1);
+  }
+  for (int b = 0; b < n_blocks; b++) {
+    fmt::print(out, "{} 0 0 0 1 1 1 1 {} 0\n", b + 1, 10 + b);
+  }
+  fmt::print(out, "$EndEntities\n");
+
+  int64_t n_nodes = static_cast<int64_t>(n + 1) * (n + 1) * (nz + 1);
+  fmt::print(out, "$Nodes\n1 {} {} {}\n{} 1 0 {}\n", n_nodes, node_id(0, 0, 0),
+             node_id(n, n, nz), dim, n_nodes);
+  for (int k = 0; k <= nz; k++) {
+    for (int j = 0; j <= n; j++) {
+      for (int i = 0; i <= n; i++) {
+        fmt::print(out, "{}\n", node_id(i, j, k));
+      }
+    }
+  }
+  for (int k = 0; k <= nz; k++) {
+    for (int j = 0; j <= n; j++) {
+      for (int i = 0; i <= n; i++) {
+        fmt::print(out, "{:.16g} {:.16g} {:.16g}\n", 1.0 * i / n,
+                   0.5 * j / n, solid ? 0.25 * k / nz : 0.0);
+      }
+    }
+  }
+  fmt::print(out, "$EndNodes\n");
+
+  // boundary sides as node id lists, split like the cells
+  std::vector<std::vector<std::vector<int64_t>>> sides(3);
+  if (solid) {
+    for (int a = 0; a < n; a++) {
+      for (int c = 0; c < n; c++) {
+        sides[0].push_back({node_id(0, a, c), node_id(0, a + 1, c),
+                            node_id(0, a + 1, c + 1), node_id(0, a, c + 1)});
+        sides[1].push_back({node_id(n, a, c), node_id(n, a + 1, c),
+                            node_id(n, a + 1, c + 1), node_id(n, a, c + 1)});
+        sides[2].push_back({node_id(a, c, 0), node_id(a + 1, c, 0),
+                            node_id(a + 1, c + 1, 0), node_id(a, c + 1, 0)});
+      }
+    }
+    if (kind == "tet") {
+      for (auto &boundary_sides : sides) {
+        std::vector<std::vector<int64_t>> tris;
+        for (const auto &q : boundary_sides) {
+          tris.push_back({q[0], q[1], q[2]});
+          tris.push_back({q[0], q[2], q[3]});
+        }
+        boundary_sides.swap(tris);
+      }
+    }
+  } else {
+    for (int a = 0; a < n; a++) {
+      sides[0].push_back({node_id(0, a, 0), node_id(0, a + 1, 0)});
+      sides[1].push_back({node_id(n, a, 0), node_id(n, a + 1, 0)});
+      sides[2].push_back({node_id(a, 0, 0), node_id(a + 1, 0, 0)});
+    }
+  }
+
+  std::vector<std::vector<std::vector<int64_t>>> cells(n_blocks);
+  for (int k = 0; k < std::max(nz, 1); k++) {
+    for (int j = 0; j < n; j++) {
+      for (int i = 0; i < n; i++) {
+        auto &block_cells = cells[static_cast<int64_t>(i) * n_blocks / n];
+        if (solid) {
+          std::array<int64_t, 8> c = {node_id(i, j, k),
+                                      node_id(i + 1, j, k),
+                                      node_id(i + 1, j + 1, k),
+                                      node_id(i, j + 1, k),
+                                      node_id(i, j, k + 1),
+                                      node_id(i + 1, j, k + 1),
+                                      node_id(i + 1, j + 1, k + 1),
+                                      node_id(i, j + 1, k + 1)};
+          if (kind == "hex") {
+            block_cells.push_back({c.begin(), c.end()});
+          } else {
+            // six tets around the 0-6 diagonal
+            const int tets[6][4] = {{0, 1, 2, 6}, {0, 2, 3, 6}, {0, 3, 7, 6},
+                                    {0, 7, 4, 6}, {0, 4, 5, 6}, {0, 5, 1, 6}};
+            for (const auto &t : tets) {
+              block_cells.push_back({c[t[0]], c[t[1]], c[t[2]], c[t[3]]});
+            }
+          }
+        } else {
+          std::array<int64_t, 4> c = {node_id(i, j, 0), node_id(i + 1, j, 0),
+                                      node_id(i + 1, j + 1, 0),
+                                      node_id(i, j + 1, 0)};
+          if (kind == "quad") {
+            block_cells.push_back({c.begin(), c.end()});
+          } else {
+            block_cells.push_back({c[0], c[1], c[2]});
+            block_cells.push_back({c[0], c[2], c[3]});
+          }
+        }
+      }
+    }
+  }
+
+  // gmsh element types of the cells and of their sides
+  const std::map<std::string, std::pair<int, int>> gmsh_types = {
+      {"hex", {5, 3}}, {"tet", {4, 2}}, {"quad", {3, 1}}, {"tri", {2, 1}}};
+  int cell_type = gmsh_types.at(kind).first;
+  int side_type = gmsh_types.at(kind).second;
+  int64_t n_elements = 0;
+  for (const auto &boundary_sides : sides) {
+    n_elements += boundary_sides.size();
+  }
+  for (const auto &block_cells : cells) {
+    n_elements += block_cells.size();
+  }
+  fmt::print(out, "$Elements\n{} {} 1 {}\n", 3 + n_blocks, n_elements,
+             n_elements);
+  int64_t elem_id = 1;
+  auto print_group = [&](int group_dim, int tag, int type,
+                         const std::vector<std::vector<int64_t>> &elems) {
+    fmt::print(out, "{} {} {} {}\n", group_dim, tag, type, elems.size());
+    for (const auto &elem : elems) {
+      fmt::print(out, "{}", elem_id++);
+      for (auto node : elem) {
+        fmt::print(out, " {}", node);
+      }
+      fmt::print(out, "\n");
+    }
+  };
+  for (int b = 0; b < 3; b++) {
+    print_group(dim - 1, b + 1, side_type, sides[b]);
+  }
+  for (int b = 0; b < n_blocks; b++) {
+    print_group(dim, b + 1, cell_type, cells[b]);
+  }
+  fmt::print(out, "$EndElements\n");
+  std::fclose(out);
+}
+
+int main(int argc, char **argv) {
+  msh2exo::set_mesh_allocation_hook(count_bytes);
+  std::vector<std::string> inputs(argv + 1, argv + argc);
+  if (inputs.empty()) {
+    struct corpus_mesh {
+      const char *kind;
+      int n;
+      int n_blocks;
+    };
+    // small and mid-size meshes, the multi-block ones exercise the
+    // element numbering across blocks
+    const corpus_mesh corpus[] = {{"hex", 8, 1},    {"hex", 40, 1},
+                                  {"hex", 40, 3},   {"tet", 8, 1},
+                                  {"tet", 30, 1},   {"tet", 30, 4},
+                                  {"quad", 16, 1},  {"quad", 300, 2},
+                                  {"tri", 16, 1},   {"tri", 300, 3}};
+    for (const auto &mesh : corpus) {
+      auto path = fmt::format("reader_diff_{}_{}_{}.msh", mesh.kind, mesh.n,
+                              mesh.n_blocks);
+      write_box_mesh(path, mesh.kind, mesh.n, mesh.n_blocks);
+      inputs.push_back(path);
+    }
+  }
+
+  fmt::print("{:32} {:>9} {:>9} | {:>9} {:>9} | {:>9} {:>9} | {}\n", "mesh",
+             "nodes", "elements", "builtin", "MiB", "sdk", "MiB", "result");
+  int n_differ = 0;
+  for (const auto &input : inputs) {
+    auto builtin =
+        timed_read([&input] { return msh2exo::read_gmsh_file(input); });
+    auto sdk =
+        timed_read([&input] { return msh2exo::read_gmsh_sdk_file(input); });
+
+    std::vector<std::string> diffs;
+    if (!builtin.error.empty()) {
+      diffs.push_back("builtin reader failed: " + builtin.error);
+    }
+    if (!sdk.error.empty()) {
+      diffs.push_back("sdk reader failed: " + sdk.error);
+    }
+    if (diffs.empty()) {
+      diffs = compare(canonicalize(builtin.mesh), canonicalize(sdk.mesh));
+    }
+    n_differ += !diffs.empty();
+
+    fmt::print("{:32} {:9} {:9} | {:8.3f}s {:9.1f} | {:8.3f}s {:9.1f} | {}\n",
+               input, builtin.mesh.n_nodes, builtin.mesh.n_elements,
+               builtin.seconds, builtin.peak_bytes / 1048576.0, sdk.seconds,
+               sdk.peak_bytes / 1048576.0,
+               diffs.empty() ? "equivalent" : "DIFFERENT");
+    for (const auto &diff : diffs) {
+      fmt::print("    {}\n", diff);
+    }
+  }
+
+  fmt::print("{} of {} meshes differ\n", n_differ, inputs.size());
+  return n_differ == 0 ? 0 : 1;
+}
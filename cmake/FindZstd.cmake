@@ -0,0 +1,45 @@
+find_path(Zstd_INCLUDE_DIRS NAMES zstd.h
+  HINTS
+  /usr/include/
+  /usr/local/include/
+  ${ZSTD_DIR}/include/
+  ${Zstd_DIR}/include/
+  ${ZSTD_INCLUDE_DIR}
+  ${Zstd_INCLUDE_DIR}
+)
+
+find_library(Zstd_LIBRARIES NAMES zstd libzstd zstd_static
+  HINTS
+  /usr/lib
+  /usr/local/lib
+  /usr/lib64
+  /usr/local/lib64
+  ${ZSTD_DIR}/lib
+  ${Zstd_DIR}/lib
+  ${ZSTD_LIBRARY_DIR}
+  ${Zstd_LIBRARY_DIR}
+)
+
+if(Zstd_INCLUDE_DIRS AND EXISTS ${Zstd_INCLUDE_DIRS}/zstd.h)
+  file(READ ${Zstd_INCLUDE_DIRS}/zstd.h ZSTD_HEADER_FILE)
+  string(REGEX MATCH "#define ZSTD_VERSION_MAJOR +([0-9]+)" _ ${ZSTD_HEADER_FILE})
+  set(Zstd_VERSION_MAJOR ${CMAKE_MATCH_1})
+  string(REGEX MATCH "#define ZSTD_VERSION_MINOR +([0-9]+)" _ ${ZSTD_HEADER_FILE})
+  set(Zstd_VERSION_MINOR ${CMAKE_MATCH_1})
+  string(REGEX MATCH "#define ZSTD_VERSION_RELEASE +([0-9]+)" _ ${ZSTD_HEADER_FILE})
+  set(Zstd_VERSION_RELEASE ${CMAKE_MATCH_1})
+  set(Zstd_VERSION
+    "${Zstd_VERSION_MAJOR}.${Zstd_VERSION_MINOR}.${Zstd_VERSION_RELEASE}"
+    CACHE INTERNAL "Zstd Version")
+endif()
+
+include(FindPackageHandleStandardArgs)
+find_package_handle_standard_args(Zstd
+  FOUND_VAR Zstd_FOUND
+  REQUIRED_VARS Zstd_LIBRARIES Zstd_INCLUDE_DIRS
+  VERSION_VAR Zstd_VERSION)
+
+mark_as_advanced(
+  Zstd_INCLUDE_DIRS
+  Zstd_LIBRARIES
+)
@@ -0,0 +1,51 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <atomic>
+
+#include "arena.hpp"
+
+static std::atomic<uint64_t> total_allocations(0);
+static std::atomic<uint64_t> total_blocks(0);
+static std::atomic<uint64_t> total_bytes(0);
+
+static char *align_up(char *ptr, size_t alignment) {
+  auto address = reinterpret_cast<uintptr_t>(ptr);
+  return ptr + ((alignment - address % alignment) % alignment);
+}
+
+void *msh2exo::arena::allocate(size_t size, size_t alignment) {
+  total_allocations++;
+  // large requests get a block of their own, the current block stays open
+  // for the small ones
+  if (size + alignment > block_size_ / 4) {
+    blocks_.emplace_back(new char[size + alignment]);
+    total_blocks++;
+    total_bytes += size + alignment;
+    return align_up(blocks_.back().get(), alignment);
+  }
+  if (cursor_ == nullptr ||
+      static_cast<size_t>(end_ - cursor_) < size + alignment) {
+    blocks_.emplace_back(new char[block_size_]);
+    total_blocks++;
+    total_bytes += block_size_;
+    cursor_ = blocks_.back().get();
+    end_ = cursor_ + block_size_;
+  }
+  char *ptr = align_up(cursor_, alignment);
+  cursor_ = ptr + size;
+  return ptr;
+}
+
+void msh2exo::arena::release() {
+  blocks_.clear();
+  cursor_ = nullptr;
+  end_ = nullptr;
+}
+
+msh2exo::arena::totals msh2exo::arena::counters() {
+  return {total_allocations.load(), total_blocks.load(), total_bytes.load()};
+}
@@ -0,0 +1,74 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace msh2exo {
+// Monotonic allocator for reader temporaries
+//
+// Memory is carved out of large blocks and only returned all at once by
+// release() (or the destructor), so the many small vectors of one reader
+// phase cost a handful of heap allocations and are freed together as soon
+// as the phase's data has been consumed.
+class arena {
+public:
+  struct totals {
+    // allocations served and heap blocks taken, over all arenas
+    uint64_t n_allocations;
+    uint64_t n_blocks;
+    uint64_t bytes;
+  };
+
+  explicit arena(size_t block_size = 1 << 20) : block_size_(block_size) {}
+  ~arena() { release(); }
+
+  arena(const arena &) = delete;
+  arena &operator=(const arena &) = delete;
+
+  void *allocate(size_t size, size_t alignment);
+  void release();
+
+  static totals counters();
+
+private:
+  size_t block_size_;
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char *cursor_ = nullptr;
+  char *end_ = nullptr;
+};
+
+template <typename T> class arena_allocator {
+public:
+  using value_type = T;
+
+  explicit arena_allocator(arena &pool) : pool_(&pool) {}
+  template <typename U>
+  arena_allocator(const arena_allocator<U> &other) : pool_(other.pool_) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(pool_->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *, size_t) {}
+
+  template <typename U> bool operator==(const arena_allocator<U> &other) const {
+    return pool_ == other.pool_;
+  }
+  template <typename U> bool operator!=(const arena_allocator<U> &other) const {
+    return pool_ != other.pool_;
+  }
+
+private:
+  template <typename U> friend class arena_allocator;
+  arena *pool_;
+};
+
+template <typename T> using arena_vector = std::vector<T, arena_allocator<T>>;
+} // namespace msh2exo
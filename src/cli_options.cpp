@@ -0,0 +1,117 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2020 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include "CLI/App.hpp"
+#include "CLI/Config.hpp"
+#include "CLI/Formatter.hpp"
+
+#include "cli_options.hpp"
+
+void msh2exo::setup_options(CLI::App &app, msh2exo::Options &options) {
+
+  app.add_flag("-V,--version", options.version,
+               "print version and basic info");
+
+  // not needed with --version, checked in run_msh2exo
+  app.add_option("input_file", options.input_file,
+                 "Input (Gmsh msh or msh2exo snapshot) mesh file, a pipe or "
+                 "- for standard input")
+      ->check(CLI::ExistingFile | CLI::IsMember({"-"}));
+
+  // not needed with --info, checked in run_msh2exo
+  app.add_option("output_file", options.output_file,
+                 "Output (ExodusII) mesh file");
+  app.add_flag("-b,--builtin", options.builtin, "Use builtin gmsh file reader");
+
+  app.add_flag("-v,--verbose", options.verbose, "increase verbosity");
+
+  app.add_option("--cache-dir", options.cache_dir,
+                 "Reuse mesh snapshots cached in this directory, keyed by a "
+                 "hash of the input file")
+      ->check(CLI::ExistingDirectory);
+
+  app.add_option("--snapshot", options.snapshot_file,
+                 "Also write a binary snapshot of the mesh to this file");
+
+  app.add_option("--merge-nodes", options.merge_tolerance,
+                 "Merge nodes closer than this distance")
+      ->check(CLI::PositiveNumber);
+
+  app.add_option("--refine", options.refine,
+                 "Uniformly refine tri3, quad4, tet4 and hex8 elements this "
+                 "many times")
+      ->check(CLI::NonNegativeNumber);
+
+  app.add_option("--order", options.order,
+                 "Element order, 2 promotes tri3, quad4, tet4 and hex8 "
+                 "elements to tri6, quad9, tet10 and hex27")
+      ->check(CLI::Range(1, 2));
+
+  app.add_option("--extrude", options.extrude,
+                 "Extrude a 2D mesh along z into this many layers up to this "
+                 "height, quad4 to hex8 and tri3 to wedge6 elements")
+      ->expected(2)
+      ->delimiter(',')
+      ->type_name("LAYERS,HEIGHT");
+
+  app.add_option("--scale", options.scale,
+                 "Scale the written coordinates by this factor, or by one "
+                 "factor per axis")
+      ->delimiter(',')
+      ->type_name("S|SX,SY,SZ");
+
+  app.add_option("--rotate", options.rotate,
+                 "Rotate the written mesh about the x, y and z axes by these "
+                 "angles in degrees, after scaling")
+      ->expected(3)
+      ->delimiter(',')
+      ->type_name("RX,RY,RZ");
+
+  app.add_option("--translate", options.translate,
+                 "Translate the written mesh by this vector, after scaling "
+                 "and rotating")
+      ->expected(3)
+      ->delimiter(',')
+      ->type_name("DX,DY,DZ");
+
+  app.add_option("--threads", options.threads,
+                 "Threads for parallel mesh operations (default: all cores)")
+      ->check(CLI::NonNegativeNumber);
+
+  app.add_flag("--check", options.check,
+               "Report element quality, fail on inverted or degenerate "
+               "elements");
+
+  app.add_flag("--fix-orientation", options.fix_orientation,
+               "Reorder inverted tri and tet elements (implies --check)");
+
+  app.add_flag("--skin", options.skin,
+               "Add a sideset of all exterior element sides");
+
+  app.add_flag("--interfaces", options.interfaces,
+               "Add a sideset for the sides shared by each pair of blocks");
+
+  app.add_flag("--fields", options.fields,
+               "Convert msh $NodeData/$ElementData sections to ExodusII "
+               "variables");
+
+  app.add_flag("--watch", options.watch,
+               "Keep running and reconvert whenever the input file changes");
+
+  app.add_flag("--info", options.info,
+               "Print node, element and physical group counts and the "
+               "estimated peak memory of the conversion as JSON, reading "
+               "only the msh section headers, and exit");
+
+  app.add_flag("--progress", options.progress,
+               "Print progress, rate and ETA to stderr every second");
+
+  app.add_option("--status-file", options.status_file,
+                 "Keep the progress of the conversion in this JSON file");
+
+  // app.add_flag("-f,--force", options.force,
+  //               "Force, overwrite existing ExodusII file");
+}
@@ -0,0 +1,15 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2020 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+#include "CLI/App.hpp"
+
+#include "options.hpp"
+
+namespace msh2exo {
+// command line of the msh2exo executable, not part of libmsh2exo
+void setup_options(CLI::App &app, Options &options);
+} // namespace msh2exo
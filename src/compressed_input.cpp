@@ -0,0 +1,377 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fmt/format.h>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include "compressed_input.hpp"
+#include "config.hpp"
+#include "util.hpp"
+
+#ifdef ENABLE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#ifdef ENABLE_ZLIB
+// ends the inflate stream however decompression is left
+struct inflate_guard {
+  z_stream &stream;
+  ~inflate_guard() { inflateEnd(&stream); }
+};
+#endif
+
+static msh2exo::compression detect_magic(const unsigned char *magic) {
+  if (magic[0] == 0x1f && magic[1] == 0x8b) {
+    return msh2exo::compression::gzip;
+  }
+  if (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+      magic[3] == 0xfd) {
+    return msh2exo::compression::zstd;
+  }
+  return msh2exo::compression::none;
+}
+
+bool msh2exo::is_stream_input(const std::string &path) {
+  if (path == "-") {
+    return true;
+  }
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 &&
+         (info.st_mode & S_IFMT) != S_IFREG;
+}
+
+msh2exo::compression msh2exo::detect_compression(const std::string &path) {
+  if (is_stream_input(path)) {
+    return compression::none;
+  }
+  std::ifstream in(path, std::ios::binary);
+  unsigned char magic[4] = {0, 0, 0, 0};
+  in.read(reinterpret_cast<char *>(magic), sizeof(magic));
+  return detect_magic(magic);
+}
+
+// Input is read (and decompressed) in blocks by a worker thread; at most
+// queue_depth blocks are in flight so memory stays bounded however large
+// the file is. Bytes already taken from the file to detect its type are
+// passed in as the prefix and read first.
+class decompressing_streambuf : public std::streambuf {
+public:
+  static const size_t block_size = 4 << 20;
+  static const size_t queue_depth = 4;
+
+  decompressing_streambuf(std::FILE *file, bool owned,
+                          msh2exo::compression type, std::vector<char> prefix)
+      : file_(file), owned_(owned), type_(type), prefix_(std::move(prefix)) {
+    for (size_t i = 0; i < queue_depth + 1; i++) {
+      free_.emplace_back();
+      free_.back().reserve(block_size);
+    }
+    worker_ = std::thread([this] { produce(); });
+  }
+
+  ~decompressing_streambuf() override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    changed_.notify_all();
+    worker_.join();
+    if (owned_) {
+      std::fclose(file_);
+    }
+  }
+
+protected:
+  int_type underflow() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!current_.empty()) {
+      free_.push_back(std::move(current_));
+      current_.clear();
+      changed_.notify_all();
+    }
+    changed_.wait(lock, [this] { return !full_.empty() || done_; });
+    if (full_.empty()) {
+      if (error_) {
+        std::rethrow_exception(error_);
+      }
+      return traits_type::eof();
+    }
+    current_ = std::move(full_.front());
+    full_.pop_front();
+    changed_.notify_all();
+    setg(current_.data(), current_.data(), current_.data() + current_.size());
+    return traits_type::to_int_type(current_[0]);
+  }
+
+private:
+  // blocks until a free block is available, false when shutting down
+  bool take_free(std::vector<char> &block) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return !free_.empty() || stop_; });
+    if (stop_) {
+      return false;
+    }
+    block = std::move(free_.back());
+    free_.pop_back();
+    return true;
+  }
+
+  bool stopping() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stop_;
+  }
+
+  // Waits for input in short polls, so a stalled pipe can not keep the
+  // destructor from joining; false when shutting down. Regular files are
+  // always ready.
+  bool wait_readable() {
+#ifndef _WIN32
+    pollfd fd = {fileno(file_), POLLIN, 0};
+    while (poll(&fd, 1, 100) == 0) {
+      if (stopping()) {
+        return false;
+      }
+    }
+#endif
+    return !stopping();
+  }
+
+  bool push_full(std::vector<char> &block) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stop_) {
+      return false;
+    }
+    full_.push_back(std::move(block));
+    changed_.notify_all();
+    return true;
+  }
+
+  void produce() {
+    try {
+      switch (type_) {
+      case msh2exo::compression::gzip:
+        produce_gzip();
+        break;
+      case msh2exo::compression::zstd:
+        produce_zstd();
+        break;
+      case msh2exo::compression::none:
+        produce_plain();
+        break;
+      }
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      error_ = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+    changed_.notify_all();
+  }
+
+  // The prefix first, then the file, which may return fewer bytes than
+  // asked for. 0 at the end of the input or when shutting down.
+  size_t read_input(void *data, size_t size) {
+    size_t n = std::min(size, prefix_.size() - prefix_pos_);
+    std::memcpy(data, prefix_.data() + prefix_pos_, n);
+    prefix_pos_ += n;
+    if (n > 0 || !wait_readable()) {
+      return n;
+    }
+#ifdef _WIN32
+    n = std::fread(data, 1, size, file_);
+    MSH2EXO_READ_CHECK(!std::ferror(file_), "read error");
+#else
+    ssize_t count;
+    do {
+      count = read(fileno(file_), data, size);
+    } while (count < 0 && errno == EINTR);
+    MSH2EXO_READ_CHECK(count >= 0,
+                       fmt::format("read error ({})", std::strerror(errno)));
+    n = count;
+#endif
+    return n;
+  }
+
+  void produce_plain() {
+    std::vector<char> block;
+    while (take_free(block)) {
+      block.resize(block_size);
+      block.resize(read_input(block.data(), block.size()));
+      if (block.empty() || !push_full(block)) {
+        break;
+      }
+    }
+  }
+
+  void produce_gzip() {
+#ifdef ENABLE_ZLIB
+    std::vector<unsigned char> input(1 << 20);
+    z_stream stream = {};
+    // 15 + 32: gzip or zlib header, detected automatically
+    MSH2EXO_READ_CHECK(inflateInit2(&stream, 15 + 32) == Z_OK,
+                       "gzip: inflateInit2 failed");
+    inflate_guard guard{stream};
+    std::vector<char> block;
+    bool finished = false;
+    int status = Z_OK;
+    while (!finished && take_free(block)) {
+      block.resize(block_size);
+      stream.next_out = reinterpret_cast<Bytef *>(block.data());
+      stream.avail_out = static_cast<uInt>(block.size());
+      while (stream.avail_out > 0) {
+        if (stream.avail_in == 0) {
+          stream.avail_in =
+              static_cast<uInt>(read_input(input.data(), input.size()));
+          stream.next_in = input.data();
+          if (stream.avail_in == 0) {
+            if (stopping()) {
+              return;
+            }
+            MSH2EXO_READ_CHECK(status == Z_STREAM_END,
+                               "gzip: unexpected end of compressed input");
+            finished = true;
+            break;
+          }
+        }
+        status = inflate(&stream, Z_NO_FLUSH);
+        if (status == Z_STREAM_END) {
+          // concatenated gzip members are decompressed back to back
+          inflateReset(&stream);
+        } else if (status != Z_OK && status != Z_BUF_ERROR) {
+          MSH2EXO_READ_CHECK(false, fmt::format("gzip: corrupt input ({})",
+                                                stream.msg ? stream.msg : ""));
+        }
+      }
+      block.resize(block.size() - stream.avail_out);
+      if (!block.empty() && !push_full(block)) {
+        break;
+      }
+    }
+#else
+    MSH2EXO_READ_CHECK(false, "gzip input requires msh2exo built with zlib");
+#endif
+  }
+
+  void produce_zstd() {
+#ifdef ENABLE_ZSTD
+    std::vector<char> input(ZSTD_DStreamInSize());
+    std::unique_ptr<ZSTD_DStream, size_t (*)(ZSTD_DStream *)> stream(
+        ZSTD_createDStream(), ZSTD_freeDStream);
+    MSH2EXO_READ_CHECK(stream != nullptr, "zstd: ZSTD_createDStream failed");
+    ZSTD_initDStream(stream.get());
+    ZSTD_inBuffer in = {input.data(), 0, 0};
+    std::vector<char> block;
+    bool finished = false;
+    // 0 once a frame is fully decoded and flushed
+    size_t status = 0;
+    while (!finished && take_free(block)) {
+      block.resize(block_size);
+      ZSTD_outBuffer out = {block.data(), block.size(), 0};
+      while (out.pos < out.size) {
+        if (in.pos == in.size) {
+          in.size = read_input(input.data(), input.size());
+          in.pos = 0;
+          if (in.size == 0) {
+            if (stopping()) {
+              return;
+            }
+            MSH2EXO_READ_CHECK(status == 0,
+                               "zstd: unexpected end of compressed input");
+            finished = true;
+            break;
+          }
+        }
+        status = ZSTD_decompressStream(stream.get(), &out, &in);
+        if (ZSTD_isError(status)) {
+          MSH2EXO_READ_CHECK(false, fmt::format("zstd: corrupt input ({})",
+                                                ZSTD_getErrorName(status)));
+        }
+      }
+      block.resize(out.pos);
+      if (!block.empty() && !push_full(block)) {
+        break;
+      }
+    }
+#else
+    MSH2EXO_READ_CHECK(false, "zstd input requires msh2exo built with zstd");
+#endif
+  }
+
+  std::FILE *file_;
+  bool owned_;
+  msh2exo::compression type_;
+  std::vector<char> prefix_;
+  size_t prefix_pos_ = 0;
+  std::thread worker_;
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<std::vector<char>> full_;
+  std::vector<std::vector<char>> free_;
+  std::vector<char> current_;
+  std::exception_ptr error_;
+  bool stop_ = false;
+  bool done_ = false;
+};
+
+std::unique_ptr<std::streambuf> msh2exo::open_input(const std::string &path) {
+  if (is_stream_input(path)) {
+    // a pipe can only be read once, the type is detected from the first
+    // bytes, which are then handed on
+    bool owned = path != "-";
+    std::FILE *file = owned ? std::fopen(path.c_str(), "rb") : stdin;
+    MSH2EXO_READ_CHECK(file != nullptr, fmt::format("could not open {}", path));
+#ifdef _WIN32
+    if (!owned) {
+      _setmode(_fileno(stdin), _O_BINARY);
+    }
+#endif
+    // unbuffered, so the worker can read the descriptor directly after the
+    // prefix
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    std::vector<char> prefix(4);
+    prefix.resize(std::fread(prefix.data(), 1, prefix.size(), file));
+    unsigned char magic[4] = {0, 0, 0, 0};
+    std::memcpy(magic, prefix.data(), prefix.size());
+    return std::unique_ptr<std::streambuf>(new decompressing_streambuf(
+        file, owned, detect_magic(magic), std::move(prefix)));
+  }
+
+  auto type = detect_compression(path);
+  if (type != compression::none) {
+    std::FILE *file = std::fopen(path.c_str(), "rb");
+    MSH2EXO_READ_CHECK(file != nullptr, fmt::format("could not open {}", path));
+    return std::unique_ptr<std::streambuf>(
+        new decompressing_streambuf(file, true, type, {}));
+  }
+  std::unique_ptr<std::filebuf> file(new std::filebuf);
+  MSH2EXO_READ_CHECK(file->open(path, std::ios::in | std::ios::binary) !=
+                         nullptr,
+                     fmt::format("could not open {}", path));
+  return std::unique_ptr<std::streambuf>(std::move(file));
+}
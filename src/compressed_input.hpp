@@ -0,0 +1,29 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <memory>
+#include <streambuf>
+#include <string>
+
+namespace msh2exo {
+enum class compression { none, gzip, zstd };
+
+// "-" (standard input) or a pipe or device that can only be read once,
+// front to back
+bool is_stream_input(const std::string &path);
+
+// detected from the leading magic bytes, not the file extension; stream
+// inputs are not read and reported as none, open_input detects their type
+compression detect_compression(const std::string &path);
+
+// Opens path for reading, compressed files are decompressed on a background
+// thread that hands fixed size blocks to the reader through a bounded queue,
+// so the decompressed data is never written out or fully resident. Stream
+// inputs are read ahead the same way.
+std::unique_ptr<std::streambuf> open_input(const std::string &path);
+} // namespace msh2exo
@@ -0,0 +1,121 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <algorithm>
+#include <cmath>
+
+#include "coord_transform.hpp"
+
+bool msh2exo::affine_transform::is_identity() const {
+  affine_transform identity;
+  return matrix == identity.matrix && offset == identity.offset;
+}
+
+msh2exo::affine_transform msh2exo::affine_transform::with_z(double z) const {
+  affine_transform fixed = *this;
+  for (int r = 0; r < 3; r++) {
+    fixed.offset[r] += matrix[r * 3 + 2] * z;
+    fixed.matrix[r * 3 + 2] = 0;
+  }
+  return fixed;
+}
+
+bool msh2exo::affine_transform::keeps_dim(int dim) const {
+  // rotations by multiples of 90 degrees leave sines and cosines of the
+  // order of rounding, relative to the column they scale
+  for (int c = 0; c < dim; c++) {
+    double column = 0;
+    for (int r = 0; r < 3; r++) {
+      column = std::max(column, std::abs(matrix[r * 3 + c]));
+    }
+    for (int r = dim; r < 3; r++) {
+      if (std::abs(matrix[r * 3 + c]) > 1e-12 * column) {
+        return false;
+      }
+    }
+  }
+  for (int r = dim; r < 3; r++) {
+    if (offset[r] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// a * b
+static std::array<double, 9> multiply(const std::array<double, 9> &a,
+                                      const std::array<double, 9> &b) {
+  std::array<double, 9> product{};
+  for (int r = 0; r < 3; r++) {
+    for (int c = 0; c < 3; c++) {
+      for (int k = 0; k < 3; k++) {
+        product[r * 3 + c] += a[r * 3 + k] * b[k * 3 + c];
+      }
+    }
+  }
+  return product;
+}
+
+// rotation by degrees about the axis, counterclockwise looking down it
+static std::array<double, 9> rotation(int axis, double degrees) {
+  const double pi = 3.14159265358979323846;
+  double c = std::cos(degrees * pi / 180);
+  double s = std::sin(degrees * pi / 180);
+  int i = (axis + 1) % 3;
+  int j = (axis + 2) % 3;
+  std::array<double, 9> rot{{1, 0, 0, 0, 1, 0, 0, 0, 1}};
+  rot[i * 3 + i] = c;
+  rot[i * 3 + j] = -s;
+  rot[j * 3 + i] = s;
+  rot[j * 3 + j] = c;
+  return rot;
+}
+
+msh2exo::affine_transform
+msh2exo::options_transform(const Options &options) {
+  affine_transform transform;
+  if (!options.scale.empty()) {
+    for (int r = 0; r < 3; r++) {
+      transform.matrix[r * 3 + r] =
+          options.scale[options.scale.size() == 3 ? r : 0];
+    }
+  }
+  if (!options.rotate.empty()) {
+    for (int axis = 0; axis < 3; axis++) {
+      if (options.rotate[axis] != 0) {
+        transform.matrix =
+            multiply(rotation(axis, options.rotate[axis]), transform.matrix);
+      }
+    }
+  }
+  if (!options.translate.empty()) {
+    for (int r = 0; r < 3; r++) {
+      transform.offset[r] = options.translate[r];
+    }
+  }
+  return transform;
+}
+
+void msh2exo::transform_coords(const affine_transform &transform,
+                               const double *coords, int64_t begin,
+                               int64_t end, double *x, double *y, double *z) {
+  // copies keep the coefficients in registers, the stores can not alias them
+  const double a00 = transform.matrix[0], a01 = transform.matrix[1],
+               a02 = transform.matrix[2], a10 = transform.matrix[3],
+               a11 = transform.matrix[4], a12 = transform.matrix[5],
+               a20 = transform.matrix[6], a21 = transform.matrix[7],
+               a22 = transform.matrix[8];
+  const double b0 = transform.offset[0], b1 = transform.offset[1],
+               b2 = transform.offset[2];
+  for (int64_t i = begin; i < end; i++) {
+    double px = coords[i * 3];
+    double py = coords[i * 3 + 1];
+    double pz = coords[i * 3 + 2];
+    x[i] = a00 * px + a01 * py + a02 * pz + b0;
+    y[i] = a10 * px + a11 * py + a12 * pz + b1;
+    z[i] = a20 * px + a21 * py + a22 * pz + b2;
+  }
+}
@@ -0,0 +1,38 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "options.hpp"
+
+namespace msh2exo {
+// x' = matrix x + offset, matrix in row major order
+struct affine_transform {
+  std::array<double, 9> matrix{{1, 0, 0, 0, 1, 0, 0, 0, 1}};
+  std::array<double, 3> offset{{0, 0, 0}};
+
+  bool is_identity() const;
+  // the same transform of points whose z is replaced by z
+  affine_transform with_z(double z) const;
+  // whether points with zero coordinates from dim on keep them zero, up to
+  // rounding in the rotation
+  bool keeps_dim(int dim) const;
+};
+
+// --scale, then --rotate about x, y and z in that order, then --translate
+affine_transform options_transform(const Options &options);
+
+// Transforms the interleaved xyz coords of nodes [begin, end) into the
+// separate x, y and z arrays, at the same index. One branch free pass the
+// compiler vectorizes, called by the writer on the chunks it splits the
+// coordinates in anyway, so the transform costs no extra pass over memory.
+void transform_coords(const affine_transform &transform, const double *coords,
+                      int64_t begin, int64_t end, double *x, double *y,
+                      double *z);
+} // namespace msh2exo
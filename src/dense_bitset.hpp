@@ -0,0 +1,73 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace msh2exo {
+// Membership marks over a dense index range (node or element indices), one
+// bit per index. Used in place of std::set when collecting the nodes or
+// elements of a boundary: drain_sorted walks the words once to produce the
+// sorted indices and leaves the bitset cleared, so one bitset serves any
+// number of boundaries without reallocating.
+class dense_bitset {
+public:
+  dense_bitset() = default;
+  explicit dense_bitset(size_t n_bits) { resize(n_bits); }
+
+  // all bits are cleared
+  void resize(size_t n_bits) {
+    n_bits_ = n_bits;
+    words_.assign((n_bits + 63) / 64, 0);
+  }
+
+  size_t size() const { return n_bits_; }
+
+  void set(size_t i) { words_[i >> 6] |= uint64_t(1) << (i & 63); }
+  void reset(size_t i) { words_[i >> 6] &= ~(uint64_t(1) << (i & 63)); }
+  bool test(size_t i) const {
+    return (words_[i >> 6] >> (i & 63)) & uint64_t(1);
+  }
+
+  // appends the set indices to out in ascending order and clears them
+  template <typename T> void drain_sorted(std::vector<T> &out) {
+    drain([&out](size_t i) { out.push_back(static_cast<T>(i)); });
+  }
+
+  // calls func(i) for the set indices in ascending order and clears them
+  template <typename F> void drain(F &&func) {
+    for (size_t w = 0; w < words_.size(); w++) {
+      uint64_t word = words_[w];
+      while (word != 0) {
+        func(w * 64 + lowest_bit(word));
+        word &= word - 1;
+      }
+      words_[w] = 0;
+    }
+  }
+
+private:
+  static int lowest_bit(uint64_t word) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+  }
+
+  size_t n_bits_ = 0;
+  std::vector<uint64_t> words_;
+};
+} // namespace msh2exo
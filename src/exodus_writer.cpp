@@ -8,15 +8,20 @@
 #include <ctime>
 #include <fmt/ostream.h>
 #include <fmt/printf.h>
+#include <limits>
 #include <map>
-#include <set>
+#include <numeric>
 
 extern "C" {
 #include <exodusII.h>
 }
 
+#include "coord_transform.hpp"
+#include "dense_bitset.hpp"
 #include "exodus_writer.hpp"
 #include "intermediate_mesh.hpp"
+#include "parallel.hpp"
+#include "progress.hpp"
 #include "util.hpp"
 
 static const std::map<msh2exo::element_type, std::string> element_type_name = {
@@ -27,125 +32,369 @@ static const std::map<msh2exo::element_type, std::string> element_type_name = {
     {msh2exo::element_type::tri6, "TRI6"},
     {msh2exo::element_type::hex8, "HEX8"},
     {msh2exo::element_type::tet4, "TET4"},
+    {msh2exo::element_type::tet10, "TET10"},
+    {msh2exo::element_type::hex27, "HEX27"},
+    {msh2exo::element_type::wedge6, "WEDGE6"},
+};
+
+// Side s of a 2D element becomes side s of its extruded elements, which
+// have the bottom and top sides after these.
+static const std::map<msh2exo::element_type, msh2exo::element_type>
+    extruded_type = {
+        {msh2exo::element_type::tri3, msh2exo::element_type::wedge6},
+        {msh2exo::element_type::quad4, msh2exo::element_type::hex8},
 };
 
 void msh2exo::write_mesh(const IntermediateMesh &imesh,
                          const std::string &output,
                          const msh2exo::Options &options) {
+  writer_buffers buffers;
+  write_mesh(imesh, output, options, buffers);
+}
 
+// mode adds to EX_CLOBBER, e.g. the flags for 64 bit id maps
+static int create_exodus(const std::string &output, int mode = 0) {
   int cpu_size = sizeof(double);
   int io_size = sizeof(double);
-  int exoid = ex_create(output.c_str(), EX_CLOBBER, &cpu_size, &io_size);
-  const char *title = "";
+  int exoid =
+      ex_create(output.c_str(), EX_CLOBBER | mode, &cpu_size, &io_size);
+  MSH2EXO_WRITE_CHECK(exoid >= 0,
+                      fmt::format("could not create ExodusII file {}", output));
+  return exoid;
+}
 
-  std::vector<std::set<std::pair<int, int>>> elem_sides_vec(
-      imesh.boundaries.size());
+static void put_qa_record(int exoid) {
+  std::time_t tm = std::time(nullptr);
+
+  char qa_name[] = "MSH2EXO";
+  char qa_desc[] = "msh2exo";
+  char date_buffer[10];
+  char time_buffer[10];
+
+  std::strftime(date_buffer, 9, "%D", std::localtime(&tm));
+  std::strftime(time_buffer, 9, "%T", std::localtime(&tm));
+
+  char *qa_record[1][4];
+  qa_record[0][0] = qa_name;
+  qa_record[0][1] = qa_desc;
+  qa_record[0][2] = static_cast<char *>(date_buffer);
+  qa_record[0][3] = static_cast<char *>(time_buffer);
+
+  ex_put_qa(exoid, 1, qa_record);
+}
+
+// Every define call reopens the file's header, so all blocks and all sets
+// are defined (and named) in one call each, sets with null entry lists,
+// before any bulk data is written; set entries are filled in afterwards.
+static ex_block block_params(int id, const std::string &topology,
+                             int64_t n_elements, int n_nodes_per_elem) {
+  ex_block block{};
+  block.id = id;
+  block.type = EX_ELEM_BLOCK;
+  topology.copy(block.topology, sizeof(block.topology) - 1);
+  block.num_entry = n_elements;
+  block.num_nodes_per_entry = n_nodes_per_elem;
+  return block;
+}
+
+// entries and extra may be null to only define the set
+static ex_set set_params(ex_entity_type type, int id, int64_t n_entries,
+                         int *entries, int *extra) {
+  ex_set set{};
+  set.id = id;
+  set.type = type;
+  set.num_entry = n_entries;
+  set.entry_list = entries;
+  set.extra_list = extra;
+  return set;
+}
+
+static void put_names(int exoid, ex_entity_type type,
+                      std::vector<std::string> &names) {
+  if (names.empty()) {
+    return;
+  }
+  std::vector<char *> name_ptrs;
+  for (auto &name : names) {
+    name_ptrs.push_back(&name[0]);
+  }
+  ex_put_names(exoid, type, name_ptrs.data());
+}
+
+static void put_blocks(int exoid, const std::vector<ex_block> &blocks,
+                       std::vector<std::string> &names,
+                       const std::string &output) {
+  if (blocks.empty()) {
+    return;
+  }
+  MSH2EXO_WRITE_CHECK(
+      ex_put_block_params(exoid, blocks.size(), blocks.data()) == EX_NOERR,
+      fmt::format("{}: ex_put_block_params failed", output));
+  put_names(exoid, EX_ELEM_BLOCK, names);
+}
+
+// node sets first, then side sets, each named in the order given
+static void put_sets(int exoid, const std::vector<ex_set> &sets,
+                     std::vector<std::string> &node_set_names,
+                     std::vector<std::string> &side_set_names,
+                     const std::string &output) {
+  if (sets.empty()) {
+    return;
+  }
+  MSH2EXO_WRITE_CHECK(ex_put_sets(exoid, sets.size(), sets.data()) == EX_NOERR,
+                      fmt::format("{}: ex_put_sets failed", output));
+  put_names(exoid, EX_NODE_SET, node_set_names);
+  put_names(exoid, EX_SIDE_SET, side_set_names);
+}
+
+// The node and element ID maps hold the Gmsh tags, written while every node
+// (element) has one; refinement drops the element tags. Maps are 32 bit
+// unless an id needs more.
+static bool has_tags(const std::vector<int64_t> &tags, int64_t n) {
+  return !tags.empty() && tags.size() == static_cast<size_t>(n);
+}
+
+static int64_t max_tag(const std::vector<int64_t> &tags) {
+  return tags.empty() ? 0 : *std::max_element(tags.begin(), tags.end());
+}
 
+static int id_map_mode(int64_t max_id) {
+  return max_id > std::numeric_limits<int>::max()
+             ? EX_MAPS_INT64_DB | EX_MAPS_INT64_API
+             : 0;
+}
+
+template <typename Int>
+static void put_id_map_as(int exoid, ex_entity_type type, int64_t start,
+                          const int64_t *tags, int64_t n, int64_t offset,
+                          const std::string &output) {
+  std::vector<Int> ids(n);
+  msh2exo::parallel_for(0, n, [&](int64_t i) { ids[i] = tags[i] + offset; });
+  MSH2EXO_WRITE_CHECK(
+      ex_put_partial_id_map(exoid, type, start, n, ids.data()) == EX_NOERR,
+      fmt::format("{}: ex_put_partial_id_map failed", output));
+}
+
+// ids start to start + n - 1 of the map are the n tags plus offset
+static void put_id_map(int exoid, ex_entity_type type, int64_t start,
+                       const int64_t *tags, int64_t n, int64_t offset,
+                       const std::string &output) {
+  if (ex_int64_status(exoid) & EX_MAPS_INT64_API) {
+    put_id_map_as<int64_t>(exoid, type, start, tags, n, offset, output);
+  } else {
+    put_id_map_as<int>(exoid, type, start, tags, n, offset, output);
+  }
+}
+
+// (element, side) pairs of each boundary, 1-based and sorted. Boundaries
+// are searched in parallel, every thread marking the boundary nodes and
+// the elements touching them in its own bitsets; the element marks are
+// read back in ascending order, so the pairs come out sorted.
+static std::vector<std::vector<std::pair<int, int>>>
+find_boundary_sides(const msh2exo::IntermediateMesh &imesh,
+                    const std::string &output,
+                    const msh2exo::Options &options) {
+  std::vector<int64_t> block_elem_start(imesh.n_blocks + 1);
   int64_t elem_offset = 0;
-  std::map<int64_t, std::set<int64_t>> node_elem_map;
-  std::map<int64_t, size_t> elem_block_map;
-  std::vector<int64_t> block_elem_start(imesh.n_blocks);
-  msh2exo::print_if(options.verbose, "{}: Generating node_elem_map\n", output);
   for (int i = 0; i < imesh.n_blocks; i++) {
     block_elem_start[i] = elem_offset;
-    for (int j = 0; j < imesh.blocks[i].n_elements; j++) {
-      int elem = elem_offset + j;
-      elem_block_map.insert({elem, i});
-      int n_nodes_per_elem = elem_info_map.at(imesh.blocks[i].type).n_nodes;
-      for (int k = 0; k < n_nodes_per_elem; k++) {
-        int node = imesh.blocks[i].connectivity[j * n_nodes_per_elem + k];
-        if (node_elem_map.find(node) != node_elem_map.end()) {
-          node_elem_map.at(node).insert(elem);
-        } else {
-          node_elem_map.insert({node, {elem}});
+    elem_offset += imesh.blocks[i].n_elements;
+  }
+  block_elem_start[imesh.n_blocks] = elem_offset;
+
+  bool search_sides = std::any_of(
+      imesh.boundaries.begin(), imesh.boundaries.end(),
+      [](const auto &bound) { return bound.side_elems.empty(); });
+
+  // elements around each node, in compressed rows
+  std::vector<int64_t> node_elem_start;
+  std::vector<int64_t> node_elems;
+  if (search_sides) {
+    msh2exo::print_if(options.verbose, "{}: Generating node_elem_map\n",
+                      output);
+    node_elem_start.assign(imesh.n_nodes + 1, 0);
+    for (const auto &block : imesh.blocks) {
+      for (auto node : block.connectivity) {
+        node_elem_start[node + 1]++;
+      }
+    }
+    for (int64_t i = 0; i < imesh.n_nodes; i++) {
+      node_elem_start[i + 1] += node_elem_start[i];
+    }
+    node_elems.resize(node_elem_start[imesh.n_nodes]);
+    std::vector<int64_t> fill(node_elem_start.begin(),
+                              node_elem_start.end() - 1);
+    for (int i = 0; i < imesh.n_blocks; i++) {
+      const auto &block = imesh.blocks[i];
+      int n_nodes_per_elem = msh2exo::elem_info_map.at(block.type).n_nodes;
+      for (int64_t j = 0; j < block.n_elements; j++) {
+        for (int k = 0; k < n_nodes_per_elem; k++) {
+          auto node = block.connectivity[j * n_nodes_per_elem + k];
+          node_elems[fill[node]++] = block_elem_start[i] + j;
         }
       }
     }
-    elem_offset += imesh.blocks[i].n_elements;
   }
 
   msh2exo::print_if(options.verbose, "{}: Generating side set pairs\n", output);
-  // side sets
-  int n_side_sets = 0;
+  int64_t n_search_nodes = 0;
   for (size_t i = 0; i < imesh.boundaries.size(); i++) {
-    std::set<std::pair<int, int>> &elem_sides = elem_sides_vec[i];
-    std::set<int64_t> nodes(imesh.boundaries[i].nodes.begin(),
-                            imesh.boundaries[i].nodes.end());
-    std::set<int64_t> elem_seen;
-
-    msh2exo::print_if(options.verbose,
-                      "{}: Searching boundary {} for sides, {} nodes\n", output,
-                      i, nodes.size());
-
-    for (auto node : imesh.boundaries[i].nodes) {
-      for (auto elem : node_elem_map.at(node)) {
-        if (elem_seen.find(elem) == elem_seen.end()) {
-          elem_seen.insert(elem);
-
-          auto block = elem_block_map.at(elem);
-          const auto &info = elem_info_map.at(imesh.blocks[block].type);
-
-          for (int side = 0; side < info.n_sides; side++) {
-            const auto &local_nodes = info.local_side_order[side];
-            bool found = true;
-            for (size_t ln = 0; ln < local_nodes.size(); ln++) {
-              auto side_node =
-                  imesh.blocks[block]
-                      .connectivity[(elem - block_elem_start[block]) *
-                                        info.n_nodes +
-                                    local_nodes[ln]];
-              if (nodes.find(side_node) == nodes.end()) {
-                found = false;
-              }
-            }
+    if (imesh.boundaries[i].side_elems.empty()) {
+      msh2exo::print_if(options.verbose,
+                        "{}: Searching boundary {} for sides, {} nodes\n",
+                        output, i, imesh.boundaries[i].nodes.size());
+      n_search_nodes += imesh.boundaries[i].nodes.size();
+    }
+  }
+  msh2exo::progress_stage("searching sides", n_search_nodes, "nodes");
+
+  std::vector<std::vector<std::pair<int, int>>> elem_sides_vec(
+      imesh.boundaries.size());
+  std::vector<msh2exo::dense_bitset> thread_node_marks(msh2exo::thread_count());
+  std::vector<msh2exo::dense_bitset> thread_elem_marks(msh2exo::thread_count());
+  auto find_sides = [&](int64_t begin, int64_t end, int thread) {
+    auto &node_marks = thread_node_marks[thread];
+    auto &elem_marks = thread_elem_marks[thread];
+    if (search_sides) {
+      node_marks.resize(imesh.n_nodes);
+      elem_marks.resize(imesh.n_elements);
+    }
+    for (int64_t i = begin; i < end; i++) {
+      const auto &bound = imesh.boundaries[i];
+      auto &elem_sides = elem_sides_vec[i];
+      if (!bound.side_elems.empty()) {
+        for (size_t k = 0; k < bound.side_elems.size(); k++) {
+          elem_sides.push_back(
+              {bound.side_elems[k] + 1, bound.side_ids[k] + 1});
+        }
+        std::sort(elem_sides.begin(), elem_sides.end());
+        elem_sides.erase(std::unique(elem_sides.begin(), elem_sides.end()),
+                         elem_sides.end());
+        continue;
+      }
 
-            if (found) {
-              elem_sides.insert({elem + 1, side + 1});
+      for (auto node : bound.nodes) {
+        node_marks.set(node);
+        for (auto k = node_elem_start[node]; k < node_elem_start[node + 1];
+             k++) {
+          elem_marks.set(node_elems[k]);
+        }
+      }
+      int64_t n_searched = 0;
+      elem_marks.drain([&](size_t index) {
+        auto elem = static_cast<int64_t>(index);
+        n_searched++;
+        auto block = std::upper_bound(block_elem_start.begin(),
+                                      block_elem_start.end(), elem) -
+                     block_elem_start.begin() - 1;
+        const auto &mesh_block = imesh.blocks[block];
+        const auto &info = msh2exo::elem_info_map.at(mesh_block.type);
+        const auto *conn = mesh_block.connectivity.data() +
+                           (elem - block_elem_start[block]) * info.n_nodes;
+        for (int side = 0; side < info.n_sides; side++) {
+          bool found = true;
+          for (auto ln : info.local_side_order[side]) {
+            if (!node_marks.test(conn[ln])) {
+              found = false;
+              break;
             }
           }
+          if (found) {
+            elem_sides.push_back({static_cast<int>(elem) + 1, side + 1});
+          }
         }
+      });
+      for (auto node : bound.nodes) {
+        node_marks.reset(node);
       }
+      msh2exo::progress_add(msh2exo::progress.elements_searched, n_searched);
+      msh2exo::progress_add(msh2exo::progress.done, bound.nodes.size());
     }
+  };
+  msh2exo::parallel_for_chunks(0, imesh.boundaries.size(), find_sides, 1);
 
-    if (elem_sides.size() > 0) {
-      n_side_sets++;
-    }
-  }
+  return elem_sides_vec;
+}
 
-  msh2exo::print_if(options.verbose, "{}: Initializing exodus\n", output);
-  ex_put_init(exoid, title, imesh.dim, imesh.n_nodes, imesh.n_elements,
-              imesh.n_blocks, imesh.boundaries.size(), n_side_sets);
+void msh2exo::write_mesh(const IntermediateMesh &imesh,
+                         const std::string &output,
+                         const msh2exo::Options &options,
+                         writer_buffers &buffers) {
 
-  std::time_t tm = std::time(nullptr);
+  auto transform = options_transform(options);
+  MSH2EXO_CHECK(transform.keeps_dim(imesh.dim),
+                fmt::format("{}: --rotate or --translate moves the {}D mesh "
+                            "out of its coordinate axes",
+                            output, imesh.dim));
 
-  char qa_name[] = "MSH2EXO";
-  char qa_desc[] = "msh2exo";
-  char date_buffer[10];
-  char time_buffer[10];
+  bool node_map = has_tags(imesh.node_tags, imesh.n_nodes);
+  bool elem_map = has_tags(imesh.elem_tags, imesh.n_elements);
+  int exoid = create_exodus(
+      output, id_map_mode(std::max(node_map ? max_tag(imesh.node_tags) : 0,
+                                   elem_map ? max_tag(imesh.elem_tags) : 0)));
+  const char *title = "";
 
-  std::strftime(date_buffer, 9, "%D", std::localtime(&tm));
-  std::strftime(time_buffer, 9, "%T", std::localtime(&tm));
+  auto elem_sides_vec = find_boundary_sides(imesh, output, options);
 
-  char *qa_record[1][4];
-  qa_record[0][0] = qa_name;
-  qa_record[0][1] = qa_desc;
-  qa_record[0][2] = static_cast<char *>(date_buffer);
-  qa_record[0][3] = static_cast<char *>(time_buffer);
+  int n_side_sets = std::count_if(
+      elem_sides_vec.begin(), elem_sides_vec.end(),
+      [](const auto &elem_sides) { return !elem_sides.empty(); });
 
-  ex_put_qa(exoid, 1, qa_record);
+  msh2exo::print_if(options.verbose, "{}: Initializing exodus\n", output);
+  int status =
+      ex_put_init(exoid, title, imesh.dim, imesh.n_nodes, imesh.n_elements,
+                  imesh.n_blocks, imesh.boundaries.size(), n_side_sets);
+  MSH2EXO_WRITE_CHECK(status == EX_NOERR,
+                      fmt::format("{}: ex_put_init failed", output));
+
+  put_qa_record(exoid);
 
   msh2exo::print_if(options.verbose, "{}: inserting connectivity\n", output);
+  std::vector<ex_block> blocks;
+  std::vector<std::string> block_names;
   for (int i = 0; i < imesh.n_blocks; i++) {
-    std::vector<int> conn1(imesh.blocks[i].connectivity.size());
-    for (size_t j = 0; j < conn1.size(); j++) {
-      conn1[j] = imesh.blocks[i].connectivity[j] + 1;
-    }
-    ex_put_block(exoid, EX_ELEM_BLOCK, i + 1,
-                 element_type_name.at(imesh.blocks[i].type).c_str(),
-                 imesh.blocks[i].n_elements,
-                 elem_info_map.at(imesh.blocks[i].type).n_nodes, 0, 0, 0);
-    ex_put_name(exoid, EX_ELEM_BLOCK, i + 1, imesh.blocks[i].name.c_str());
+    MSH2EXO_WRITE_CHECK(
+        element_type_name.find(imesh.blocks[i].type) != element_type_name.end(),
+        fmt::format("{}: unsupported element type in block {}", output,
+                    imesh.blocks[i].name));
+    blocks.push_back(block_params(
+        i + 1, element_type_name.at(imesh.blocks[i].type),
+        imesh.blocks[i].n_elements,
+        elem_info_map.at(imesh.blocks[i].type).n_nodes));
+    block_names.push_back(imesh.blocks[i].name);
+  }
+  put_blocks(exoid, blocks, block_names, output);
+
+  // the sets are defined here and their entries written after the coords
+  size_t n_bounds = imesh.boundaries.size();
+  std::vector<ex_set> sets;
+  std::vector<std::string> ns_names;
+  std::vector<std::string> ss_names;
+  for (size_t i = 0; i < n_bounds; i++) {
+    sets.push_back(set_params(EX_NODE_SET, imesh.boundaries[i].tag,
+                              imesh.boundaries[i].nodes.size(), nullptr,
+                              nullptr));
+    ns_names.push_back(imesh.boundaries[i].name);
+  }
+  for (size_t i = 0; i < n_bounds; i++) {
+    if (!elem_sides_vec[i].empty()) {
+      sets.push_back(set_params(EX_SIDE_SET, imesh.boundaries[i].tag,
+                                elem_sides_vec[i].size(), nullptr, nullptr));
+      ss_names.push_back(imesh.boundaries[i].name);
+    }
+  }
+  put_sets(exoid, sets, ns_names, ss_names, output);
+
+  msh2exo::progress_stage("writing", imesh.n_elements, "elements");
+  for (int i = 0; i < imesh.n_blocks; i++) {
+    auto &conn1 = buffers.conn;
+    const auto &conn0 = imesh.blocks[i].connectivity;
+    conn1.resize(conn0.size());
+    parallel_for(0, conn1.size(), [&](int64_t j) { conn1[j] = conn0[j] + 1; });
     ex_put_conn(exoid, EX_ELEM_BLOCK, i + 1, (void *)conn1.data(), NULL, NULL);
+    msh2exo::progress_add(msh2exo::progress.elements_written,
+                          imesh.blocks[i].n_elements);
+    msh2exo::progress_add(msh2exo::progress.done, imesh.blocks[i].n_elements);
     msh2exo::print_if(
         options.verbose,
         "\t BLOCK {} (id {}): type {}, n_elements {}, n_nodes_per_elem {}\n",
@@ -154,13 +403,24 @@ void msh2exo::write_mesh(const IntermediateMesh &imesh,
         elem_info_map.at(imesh.blocks[i].type).n_nodes);
   }
 
-  std::vector<double> x_coords(imesh.n_nodes);
-  std::vector<double> y_coords(imesh.n_nodes);
-  std::vector<double> z_coords(imesh.n_nodes);
-  for (int64_t i = 0; i < imesh.n_nodes; i++) {
-    x_coords[i] = imesh.coords[i * 3];
-    y_coords[i] = imesh.coords[i * 3 + 1];
-    z_coords[i] = imesh.coords[i * 3 + 2];
+  auto &x_coords = buffers.x;
+  auto &y_coords = buffers.y;
+  auto &z_coords = buffers.z;
+  x_coords.resize(imesh.n_nodes);
+  y_coords.resize(imesh.n_nodes);
+  z_coords.resize(imesh.n_nodes);
+  if (transform.is_identity()) {
+    parallel_for(0, imesh.n_nodes, [&](int64_t i) {
+      x_coords[i] = imesh.coords[i * 3];
+      y_coords[i] = imesh.coords[i * 3 + 1];
+      z_coords[i] = imesh.coords[i * 3 + 2];
+    });
+  } else {
+    parallel_for_chunks(
+        0, imesh.n_nodes, [&](int64_t begin, int64_t end, int) {
+          transform_coords(transform, imesh.coords.data(), begin, end,
+                           x_coords.data(), y_coords.data(), z_coords.data());
+        });
   }
 
   msh2exo::print_if(options.verbose, "{}: inserting coords\n", output);
@@ -172,47 +432,321 @@ void msh2exo::write_mesh(const IntermediateMesh &imesh,
     ex_put_coord(exoid, x_coords.data(), y_coords.data(), z_coords.data());
   }
 
-  msh2exo::print_if(options.verbose, "{}: inserting nodesets\n", output);
-  // node sets
-  for (size_t i = 0; i < imesh.boundaries.size(); i++) {
-    ex_put_set_param(exoid, EX_NODE_SET, imesh.boundaries[i].tag,
-                     imesh.boundaries[i].nodes.size(), 0);
-    std::vector<int> ns_nodes(imesh.boundaries[i].nodes.begin(),
-                              imesh.boundaries[i].nodes.end());
-    std::transform(ns_nodes.begin(), ns_nodes.end(), ns_nodes.begin(),
-                   [](auto &val) { return val + 1; });
-    ex_put_set(exoid, EX_NODE_SET, imesh.boundaries[i].tag, ns_nodes.data(), 0);
-    ex_put_name(exoid, EX_NODE_SET, imesh.boundaries[i].tag,
-                imesh.boundaries[i].name.c_str());
+  msh2exo::print_if(options.verbose && (node_map || elem_map),
+                    "{}: inserting id maps\n", output);
+  if (node_map) {
+    put_id_map(exoid, EX_NODE_MAP, 1, imesh.node_tags.data(), imesh.n_nodes,
+               0, output);
+  }
+  if (elem_map) {
+    put_id_map(exoid, EX_ELEM_MAP, 1, imesh.elem_tags.data(),
+               imesh.n_elements, 0, output);
+  }
+
+  msh2exo::print_if(options.verbose, "{}: inserting sets\n", output);
+  // 1-based entry lists of every set, converted in parallel
+  std::vector<std::vector<int>> ns_nodes(n_bounds);
+  std::vector<std::vector<int>> ss_elems(n_bounds);
+  std::vector<std::vector<int>> ss_sides(n_bounds);
+  msh2exo::parallel_for_chunks(
+      0, n_bounds,
+      [&](int64_t begin, int64_t end, int) {
+        for (int64_t i = begin; i < end; i++) {
+          const auto &nodes = imesh.boundaries[i].nodes;
+          ns_nodes[i].resize(nodes.size());
+          for (size_t k = 0; k < nodes.size(); k++) {
+            ns_nodes[i][k] = nodes[k] + 1;
+          }
+          for (const auto &elem_side : elem_sides_vec[i]) {
+            ss_elems[i].push_back(elem_side.first);
+            ss_sides[i].push_back(elem_side.second);
+          }
+        }
+      },
+      1);
+
+  for (size_t i = 0; i < n_bounds; i++) {
+    MSH2EXO_WRITE_CHECK(ex_put_set(exoid, EX_NODE_SET, imesh.boundaries[i].tag,
+                                   ns_nodes[i].data(), NULL) == EX_NOERR,
+                        fmt::format("{}: ex_put_set failed", output));
+  }
+  for (size_t i = 0; i < n_bounds; i++) {
+    if (!ss_sides[i].empty()) {
+      MSH2EXO_WRITE_CHECK(ex_put_set(exoid, EX_SIDE_SET,
+                                     imesh.boundaries[i].tag,
+                                     ss_elems[i].data(),
+                                     ss_sides[i].data()) == EX_NOERR,
+                          fmt::format("{}: ex_put_set failed", output));
+    }
+  }
+
+  for (size_t i = 0; i < n_bounds; i++) {
     msh2exo::print_if(options.verbose, "\t NS {} (id {}): {} nodes\n",
                       imesh.boundaries[i].name, imesh.boundaries[i].tag,
-                      ns_nodes.size());
+                      ns_nodes[i].size());
+  }
+  for (size_t i = 0; i < n_bounds; i++) {
+    if (!ss_sides[i].empty()) {
+      msh2exo::print_if(options.verbose, "\t SS {} (id {}): {} sides\n",
+                        imesh.boundaries[i].name, imesh.boundaries[i].tag,
+                        ss_sides[i].size());
+    }
   }
 
-  msh2exo::print_if(options.verbose, "{}: inserting sidesets\n", output);
-  // side sets
+  MSH2EXO_WRITE_CHECK(ex_close(exoid) == EX_NOERR,
+                      fmt::format("{}: ex_close failed", output));
+}
+
+void msh2exo::write_extruded_mesh(const IntermediateMesh &imesh, int layers,
+                                  double height, const std::string &output,
+                                  const msh2exo::Options &options,
+                                  writer_buffers &buffers) {
+  MSH2EXO_CHECK(imesh.dim == 2, "extrude: only 2D meshes can be extruded");
+  std::vector<int64_t> block_elem_start(imesh.n_blocks + 1);
+  for (int i = 0; i < imesh.n_blocks; i++) {
+    MSH2EXO_CHECK(
+        extruded_type.find(imesh.blocks[i].type) != extruded_type.end(),
+        fmt::format("extrude: unsupported element type in block {}",
+                    imesh.blocks[i].name));
+    block_elem_start[i + 1] = block_elem_start[i] + imesh.blocks[i].n_elements;
+  }
+
+  // the copies in layer l of a node or element have its tag plus l times
+  // the largest tag
+  bool node_map = has_tags(imesh.node_tags, imesh.n_nodes);
+  bool elem_map = has_tags(imesh.elem_tags, imesh.n_elements);
+  int64_t node_tag_step = node_map ? max_tag(imesh.node_tags) : 0;
+  int64_t elem_tag_step = elem_map ? max_tag(imesh.elem_tags) : 0;
+  int exoid = create_exodus(
+      output, id_map_mode(std::max(node_tag_step * (layers + 1),
+                                   elem_tag_step * layers)));
+  const char *title = "";
+
+  auto elem_sides_vec = find_boundary_sides(imesh, output, options);
+
+  // bottom and top of every element, in the first and last layer
+  int next_tag = 1;
+  for (const auto &bound : imesh.boundaries) {
+    next_tag = std::max(next_tag, bound.tag + 1);
+  }
+  std::vector<std::pair<int, int>> bottom_sides(imesh.n_elements);
+  std::vector<std::pair<int, int>> top_sides(imesh.n_elements);
+  for (int i = 0; i < imesh.n_blocks; i++) {
+    int n_sides = elem_info_map.at(imesh.blocks[i].type).n_sides;
+    for (int64_t e = block_elem_start[i]; e < block_elem_start[i + 1]; e++) {
+      bottom_sides[e] = {static_cast<int>(e) + 1, n_sides + 1};
+      top_sides[e] = {static_cast<int>(e) + 1, n_sides + 2};
+    }
+  }
+
+  int n_side_sets = std::count_if(
+      elem_sides_vec.begin(), elem_sides_vec.end(),
+      [](const auto &elem_sides) { return !elem_sides.empty(); });
+  int64_t n_nodes = imesh.n_nodes * (layers + 1);
+  int64_t n_elements = imesh.n_elements * layers;
+
+  msh2exo::print_if(options.verbose, "{}: Initializing exodus\n", output);
+  int status = ex_put_init(exoid, title, 3, n_nodes, n_elements,
+                           imesh.n_blocks, imesh.boundaries.size() + 2,
+                           n_side_sets + 2);
+  MSH2EXO_WRITE_CHECK(status == EX_NOERR,
+                      fmt::format("{}: ex_put_init failed", output));
+
+  put_qa_record(exoid);
+
+  // nodes are numbered layer after layer, so the copy of 2D node i in layer
+  // l is l * n_nodes + i; the elements of a block are numbered the same way
+  msh2exo::print_if(options.verbose, "{}: inserting connectivity\n", output);
+  std::vector<ex_block> blocks;
+  std::vector<std::string> block_names;
+  for (int i = 0; i < imesh.n_blocks; i++) {
+    auto type = extruded_type.at(imesh.blocks[i].type);
+    blocks.push_back(block_params(i + 1, element_type_name.at(type),
+                                  imesh.blocks[i].n_elements * layers,
+                                  elem_info_map.at(type).n_nodes));
+    block_names.push_back(imesh.blocks[i].name);
+  }
+  put_blocks(exoid, blocks, block_names, output);
+
+  // the sets are defined here and filled layer by layer after the coords
+  std::vector<ex_set> sets;
+  std::vector<std::string> ns_names;
+  std::vector<std::string> ss_names;
+  for (const auto &bound : imesh.boundaries) {
+    sets.push_back(set_params(EX_NODE_SET, bound.tag,
+                              bound.nodes.size() * (layers + 1), nullptr,
+                              nullptr));
+    ns_names.push_back(bound.name);
+  }
+  sets.push_back(
+      set_params(EX_NODE_SET, next_tag, imesh.n_nodes, nullptr, nullptr));
+  sets.push_back(
+      set_params(EX_NODE_SET, next_tag + 1, imesh.n_nodes, nullptr, nullptr));
+  ns_names.push_back("extrude_bottom");
+  ns_names.push_back("extrude_top");
   for (size_t i = 0; i < imesh.boundaries.size(); i++) {
-    std::set<std::pair<int, int>> &elem_sides = elem_sides_vec[i];
+    if (!elem_sides_vec[i].empty()) {
+      sets.push_back(set_params(EX_SIDE_SET, imesh.boundaries[i].tag,
+                                elem_sides_vec[i].size() * layers, nullptr,
+                                nullptr));
+      ss_names.push_back(imesh.boundaries[i].name);
+    }
+  }
+  sets.push_back(
+      set_params(EX_SIDE_SET, next_tag, imesh.n_elements, nullptr, nullptr));
+  sets.push_back(set_params(EX_SIDE_SET, next_tag + 1, imesh.n_elements,
+                            nullptr, nullptr));
+  ss_names.push_back("extrude_bottom");
+  ss_names.push_back("extrude_top");
+  put_sets(exoid, sets, ns_names, ss_names, output);
 
-    if (elem_sides.size() > 0) {
-      std::vector<int> elems;
-      std::vector<int> sides;
+  msh2exo::progress_stage("writing", n_elements, "elements");
+  for (int i = 0; i < imesh.n_blocks; i++) {
+    const auto &block = imesh.blocks[i];
+    auto type = extruded_type.at(block.type);
+    int n_corners = elem_info_map.at(block.type).n_nodes;
+    int n_nodes_per_elem = elem_info_map.at(type).n_nodes;
+    auto &conn = buffers.conn;
+    conn.resize(block.n_elements * n_nodes_per_elem);
+    for (int layer = 0; layer < layers; layer++) {
+      int64_t bottom = layer * imesh.n_nodes + 1;
+      int64_t top = bottom + imesh.n_nodes;
+      parallel_for(0, block.n_elements, [&](int64_t j) {
+        for (int k = 0; k < n_corners; k++) {
+          auto node = block.connectivity[j * n_corners + k];
+          conn[j * n_nodes_per_elem + k] = node + bottom;
+          conn[j * n_nodes_per_elem + n_corners + k] = node + top;
+        }
+      });
+      ex_put_partial_conn(exoid, EX_ELEM_BLOCK, i + 1,
+                          layer * block.n_elements + 1, block.n_elements,
+                          (void *)conn.data(), NULL, NULL);
+      msh2exo::progress_add(msh2exo::progress.elements_written,
+                            block.n_elements);
+      msh2exo::progress_add(msh2exo::progress.done, block.n_elements);
+    }
+    msh2exo::print_if(
+        options.verbose,
+        "\t BLOCK {} (id {}): type {}, n_elements {}, n_nodes_per_elem {}\n",
+        block.name, i + 1, element_type_name.at(type),
+        block.n_elements * layers, n_nodes_per_elem);
+  }
 
-      for (auto &elem_side : elem_sides) {
-        elems.push_back(elem_side.first);
-        sides.push_back(elem_side.second);
+  auto &x_coords = buffers.x;
+  auto &y_coords = buffers.y;
+  auto &z_coords = buffers.z;
+  x_coords.resize(imesh.n_nodes);
+  y_coords.resize(imesh.n_nodes);
+  z_coords.resize(imesh.n_nodes);
+  // the extruded mesh is transformed, each layer with its own z
+  auto transform = options_transform(options);
+  bool transformed = !transform.is_identity();
+  if (!transformed) {
+    parallel_for(0, imesh.n_nodes, [&](int64_t i) {
+      x_coords[i] = imesh.coords[i * 3];
+      y_coords[i] = imesh.coords[i * 3 + 1];
+    });
+  }
+
+  msh2exo::print_if(options.verbose, "{}: inserting coords\n", output);
+  for (int layer = 0; layer <= layers; layer++) {
+    double z = height * layer / layers;
+    if (transformed) {
+      auto layer_transform = transform.with_z(z);
+      parallel_for_chunks(
+          0, imesh.n_nodes, [&](int64_t begin, int64_t end, int) {
+            transform_coords(layer_transform, imesh.coords.data(), begin, end,
+                             x_coords.data(), y_coords.data(),
+                             z_coords.data());
+          });
+    } else {
+      std::fill(z_coords.begin(), z_coords.end(), z);
+    }
+    ex_put_partial_coord(exoid, layer * imesh.n_nodes + 1, imesh.n_nodes,
+                         x_coords.data(), y_coords.data(), z_coords.data());
+  }
+
+  msh2exo::print_if(options.verbose && (node_map || elem_map),
+                    "{}: inserting id maps\n", output);
+  for (int layer = 0; node_map && layer <= layers; layer++) {
+    put_id_map(exoid, EX_NODE_MAP, layer * imesh.n_nodes + 1,
+               imesh.node_tags.data(), imesh.n_nodes, layer * node_tag_step,
+               output);
+  }
+  for (int i = 0; elem_map && i < imesh.n_blocks; i++) {
+    int64_t n_block = imesh.blocks[i].n_elements;
+    for (int layer = 0; layer < layers; layer++) {
+      put_id_map(exoid, EX_ELEM_MAP,
+                 block_elem_start[i] * layers + layer * n_block + 1,
+                 imesh.elem_tags.data() + block_elem_start[i], n_block,
+                 layer * elem_tag_step, output);
+    }
+  }
+
+  msh2exo::print_if(options.verbose, "{}: inserting sets\n", output);
+
+  // copies of the nodes in layers first to last
+  auto put_node_set = [&](int tag, const std::string &name,
+                          const std::vector<int64_t> &nodes, int first,
+                          int last) {
+    std::vector<int> ns_nodes(nodes.size());
+    for (int layer = first; layer <= last; layer++) {
+      for (size_t k = 0; k < nodes.size(); k++) {
+        ns_nodes[k] = layer * imesh.n_nodes + nodes[k] + 1;
       }
-      ex_put_set_param(exoid, EX_SIDE_SET, imesh.boundaries[i].tag,
-                       sides.size(), 0);
-      ex_put_set(exoid, EX_SIDE_SET, imesh.boundaries[i].tag, elems.data(),
-                 sides.data());
-      ex_put_name(exoid, EX_SIDE_SET, imesh.boundaries[i].tag,
-                  imesh.boundaries[i].name.c_str());
-      msh2exo::print_if(options.verbose, "\t SS {} (id {}): {} sides\n",
-                        imesh.boundaries[i].name, imesh.boundaries[i].tag,
-                        sides.size());
+      ex_put_partial_set(exoid, EX_NODE_SET, tag,
+                         (layer - first) * nodes.size() + 1, nodes.size(),
+                         ns_nodes.data(), NULL);
+    }
+    msh2exo::print_if(options.verbose, "\t NS {} (id {}): {} nodes\n", name,
+                      tag, nodes.size() * (last - first + 1));
+  };
+  for (const auto &bound : imesh.boundaries) {
+    put_node_set(bound.tag, bound.name, bound.nodes, 0, layers);
+  }
+  std::vector<int64_t> all_nodes(imesh.n_nodes);
+  std::iota(all_nodes.begin(), all_nodes.end(), 0);
+  put_node_set(next_tag, "extrude_bottom", all_nodes, 0, 0);
+  put_node_set(next_tag + 1, "extrude_top", all_nodes, layers, layers);
+
+  // copies of the (element, side) pairs in layers first to last
+  auto put_side_set = [&](int tag, const std::string &name,
+                          const std::vector<std::pair<int, int>> &elem_sides,
+                          int first, int last) {
+    std::vector<int> elems(elem_sides.size());
+    std::vector<int> sides(elem_sides.size());
+    std::vector<int64_t> block_n_elements(elem_sides.size());
+    for (size_t k = 0; k < elem_sides.size(); k++) {
+      int64_t elem = elem_sides[k].first - 1;
+      auto block = std::upper_bound(block_elem_start.begin(),
+                                    block_elem_start.end(), elem) -
+                   block_elem_start.begin() - 1;
+      block_n_elements[k] = imesh.blocks[block].n_elements;
+      elems[k] = block_elem_start[block] * layers +
+                 first * block_n_elements[k] +
+                 (elem - block_elem_start[block]) + 1;
+      sides[k] = elem_sides[k].second;
+    }
+    for (int layer = first; layer <= last; layer++) {
+      ex_put_partial_set(exoid, EX_SIDE_SET, tag,
+                         (layer - first) * elem_sides.size() + 1,
+                         elem_sides.size(), elems.data(), sides.data());
+      for (size_t k = 0; k < elem_sides.size(); k++) {
+        elems[k] += block_n_elements[k];
+      }
+    }
+    msh2exo::print_if(options.verbose, "\t SS {} (id {}): {} sides\n", name,
+                      tag, elem_sides.size() * (last - first + 1));
+  };
+  for (size_t i = 0; i < imesh.boundaries.size(); i++) {
+    if (!elem_sides_vec[i].empty()) {
+      put_side_set(imesh.boundaries[i].tag, imesh.boundaries[i].name,
+                   elem_sides_vec[i], 0, layers - 1);
     }
   }
+  put_side_set(next_tag, "extrude_bottom", bottom_sides, 0, 0);
+  put_side_set(next_tag + 1, "extrude_top", top_sides, layers - 1, layers - 1);
 
-  ex_close(exoid);
+  MSH2EXO_WRITE_CHECK(ex_close(exoid) == EX_NOERR,
+                      fmt::format("{}: ex_close failed", output));
 }
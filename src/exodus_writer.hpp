@@ -7,13 +7,36 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 #include "intermediate_mesh.hpp"
+#include "mesh_allocator.hpp"
 #include "options.hpp"
 
 namespace msh2exo {
 
+// scratch arrays of write_mesh, kept by callers converting repeatedly
+struct writer_buffers {
+  mesh_vector<int> conn;
+  mesh_vector<double> x;
+  mesh_vector<double> y;
+  mesh_vector<double> z;
+};
+
 void write_mesh(const IntermediateMesh &imesh, const std::string &output,
                 const msh2exo::Options &options);
+void write_mesh(const IntermediateMesh &imesh, const std::string &output,
+                const msh2exo::Options &options, writer_buffers &buffers);
+
+// Writes the 2D mesh extruded along z in layers of equal thickness up to
+// height, quad4 blocks as hex8 and tri3 blocks as wedge6. The 3D mesh is
+// generated and written a layer at a time and never held in memory.
+// Boundaries become the side surfaces over all layers, and sidesets of the
+// bottom and top are added. The ID map entries of the copies in layer l are
+// the Gmsh tags plus l times the largest tag.
+void write_extruded_mesh(const IntermediateMesh &imesh, int layers,
+                         double height, const std::string &output,
+                         const msh2exo::Options &options,
+                         writer_buffers &buffers);
 
 }
@@ -0,0 +1,229 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <algorithm>
+#include <array>
+#include <fmt/format.h>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include "face_sidesets.hpp"
+#include "parallel.hpp"
+#include "progress.hpp"
+#include "util.hpp"
+
+// nodes of a hex27 side
+static const size_t max_side_nodes = 9;
+
+struct face {
+  // lowest sorted side nodes, unused entries -1
+  std::array<int64_t, 4> key;
+  int64_t elem;
+  int block;
+  int side;
+};
+
+struct face_side {
+  int64_t elem;
+  int block;
+  int side;
+};
+
+static bool key_less(const face &a, const face &b) {
+  return std::tie(a.key, a.elem, a.side) < std::tie(b.key, b.elem, b.side);
+}
+
+static uint64_t key_hash(const std::array<int64_t, 4> &key) {
+  uint64_t h = 0x9E3779B97F4A7C15ULL;
+  for (auto node : key) {
+    h = (h ^ static_cast<uint64_t>(node)) * 0xC2B2AE3D27D4EB4FULL;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+static msh2exo::boundary
+make_boundary(const msh2exo::IntermediateMesh &imesh, int tag,
+              const std::string &name, std::vector<face_side> &sides) {
+  std::sort(sides.begin(), sides.end(), [](const auto &a, const auto &b) {
+    return std::tie(a.elem, a.side) < std::tie(b.elem, b.side);
+  });
+  msh2exo::boundary bound;
+  bound.tag = tag;
+  bound.name = name;
+  bound.side_elems.reserve(sides.size());
+  bound.side_ids.reserve(sides.size());
+  int64_t elem_offset = 0;
+  int block = -1;
+  for (const auto &fs : sides) {
+    if (fs.block != block) {
+      block = fs.block;
+      elem_offset = 0;
+      for (int b = 0; b < block; b++) {
+        elem_offset += imesh.blocks[b].n_elements;
+      }
+    }
+    const auto &mesh_block = imesh.blocks[block];
+    const auto &info = msh2exo::elem_info_map.at(mesh_block.type);
+    for (auto ln : info.local_side_order[fs.side]) {
+      bound.nodes.push_back(
+          mesh_block.connectivity[(fs.elem - elem_offset) * info.n_nodes + ln]);
+    }
+    bound.side_elems.push_back(fs.elem);
+    bound.side_ids.push_back(fs.side);
+  }
+  std::sort(bound.nodes.begin(), bound.nodes.end());
+  bound.nodes.erase(std::unique(bound.nodes.begin(), bound.nodes.end()),
+                    bound.nodes.end());
+  return bound;
+}
+
+int msh2exo::add_face_sidesets(IntermediateMesh &imesh, bool skin,
+                               bool interfaces) {
+  if (!skin && !interfaces) {
+    return 0;
+  }
+  progress_stage("generating sidesets", 0, "");
+
+  int64_t n_faces = 0;
+  std::vector<int64_t> block_face_start(imesh.blocks.size());
+  for (size_t b = 0; b < imesh.blocks.size(); b++) {
+    const auto &block = imesh.blocks[b];
+    auto info = elem_info_map.find(block.type);
+    MSH2EXO_CHECK(info != elem_info_map.end(),
+                  fmt::format("skin: unsupported element type in block {}",
+                              block.name));
+    block_face_start[b] = n_faces;
+    n_faces += block.n_elements * info->second.n_sides;
+  }
+
+  std::vector<face> faces(n_faces);
+  int64_t elem_offset = 0;
+  for (size_t b = 0; b < imesh.blocks.size(); b++) {
+    const auto &block = imesh.blocks[b];
+    const auto &info = elem_info_map.at(block.type);
+    parallel_for(0, block.n_elements, [&](int64_t j) {
+      for (int side = 0; side < info.n_sides; side++) {
+        auto &f = faces[block_face_start[b] + j * info.n_sides + side];
+        const auto &local_nodes = info.local_side_order[side];
+        // second order sides are keyed by their lowest four nodes, which
+        // two different conforming faces never share
+        std::array<int64_t, max_side_nodes> nodes;
+        for (size_t ln = 0; ln < local_nodes.size(); ln++) {
+          nodes[ln] = block.connectivity[j * info.n_nodes + local_nodes[ln]];
+        }
+        std::sort(nodes.begin(), nodes.begin() + local_nodes.size());
+        f.key.fill(-1);
+        std::copy_n(nodes.begin(), std::min(local_nodes.size(), f.key.size()),
+                    f.key.begin());
+        f.elem = elem_offset + j;
+        f.block = static_cast<int>(b);
+        f.side = side;
+      }
+    });
+    elem_offset += block.n_elements;
+  }
+
+  // partition faces by key hash so matching sides land in the same part,
+  // then sort and scan the parts independently
+  const int n_parts = thread_count() * 8;
+  std::vector<std::vector<int64_t>> part_count(thread_count(),
+                                               std::vector<int64_t>(n_parts));
+  parallel_for_chunks(0, n_faces, [&](int64_t begin, int64_t end, int thread) {
+    for (int64_t i = begin; i < end; i++) {
+      part_count[thread][key_hash(faces[i].key) % n_parts]++;
+    }
+  });
+  std::vector<int64_t> part_start(n_parts + 1);
+  int64_t offset = 0;
+  for (int p = 0; p < n_parts; p++) {
+    part_start[p] = offset;
+    for (auto &counts : part_count) {
+      int64_t count = counts[p];
+      counts[p] = offset;
+      offset += count;
+    }
+  }
+  part_start[n_parts] = offset;
+
+  std::vector<face> sorted(n_faces);
+  parallel_for_chunks(0, n_faces, [&](int64_t begin, int64_t end, int thread) {
+    auto &cursor = part_count[thread];
+    for (int64_t i = begin; i < end; i++) {
+      sorted[cursor[key_hash(faces[i].key) % n_parts]++] = faces[i];
+    }
+  });
+  std::vector<face>().swap(faces);
+
+  std::vector<std::vector<face_side>> part_exterior(n_parts);
+  std::vector<std::vector<std::pair<face_side, face_side>>> part_shared(
+      n_parts);
+  auto scan_parts = [&](int64_t begin, int64_t end, int) {
+    for (int64_t p = begin; p < end; p++) {
+      auto first = sorted.begin() + part_start[p];
+      auto last = sorted.begin() + part_start[p + 1];
+      std::sort(first, last, key_less);
+      while (first != last) {
+        auto run = first + 1;
+        while (run != last && run->key == first->key) {
+          ++run;
+        }
+        // sides shared by more than two elements are non-manifold and left
+        // out of both the skin and the interfaces
+        if (run - first == 1 && skin) {
+          part_exterior[p].push_back({first->elem, first->block, first->side});
+        } else if (run - first == 2 && interfaces &&
+                   first->block != (first + 1)->block) {
+          part_shared[p].push_back(
+              {{first->elem, first->block, first->side},
+               {(first + 1)->elem, (first + 1)->block, (first + 1)->side}});
+        }
+        first = run;
+      }
+    }
+  };
+  parallel_for_chunks(0, n_parts, scan_parts, 1);
+  std::vector<face>().swap(sorted);
+
+  int next_tag = 1;
+  for (const auto &bound : imesh.boundaries) {
+    next_tag = std::max(next_tag, bound.tag + 1);
+  }
+
+  int n_added = 0;
+  if (skin) {
+    std::vector<face_side> exterior;
+    for (auto &part : part_exterior) {
+      exterior.insert(exterior.end(), part.begin(), part.end());
+    }
+    imesh.boundaries.push_back(
+        make_boundary(imesh, next_tag++, "skin", exterior));
+    n_added++;
+  }
+
+  if (interfaces) {
+    std::map<std::pair<int, int>, std::vector<face_side>> block_pairs;
+    for (const auto &part : part_shared) {
+      for (const auto &shared : part) {
+        auto key = std::minmax(shared.first.block, shared.second.block);
+        auto &sides = block_pairs[key];
+        sides.push_back(shared.first);
+        sides.push_back(shared.second);
+      }
+    }
+    for (auto &pair : block_pairs) {
+      auto name =
+          fmt::format("interface_{}_{}", imesh.blocks[pair.first.first].name,
+                      imesh.blocks[pair.first.second].name);
+      imesh.boundaries.push_back(
+          make_boundary(imesh, next_tag++, name, pair.second));
+      n_added++;
+    }
+  }
+
+  return n_added;
+}
@@ -0,0 +1,20 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include "intermediate_mesh.hpp"
+
+namespace msh2exo {
+// Builds a table of every element side over all blocks, keyed by the sorted
+// side nodes from elem_info_map::local_side_order. With skin, sides seen
+// once are added as a "skin" boundary; with interfaces, sides shared by
+// elements of two different blocks are added as one boundary per block
+// pair, holding the sides of both elements. New boundaries carry explicit
+// side lists and tags above the existing ones. Returns the number of
+// boundaries added.
+int add_face_sidesets(IntermediateMesh &imesh, bool skin, bool interfaces);
+} // namespace msh2exo
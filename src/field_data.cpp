@@ -0,0 +1,345 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <algorithm>
+#include <fmt/format.h>
+#include <map>
+#include <vector>
+
+extern "C" {
+#include <exodusII.h>
+}
+
+#include "compressed_input.hpp"
+#include "field_data.hpp"
+#include "progress.hpp"
+#include "tag_lookup.hpp"
+#include "text_scanner.hpp"
+#include "util.hpp"
+
+enum class field_location { node, element, element_node };
+
+struct data_header {
+  field_location location;
+  std::string name;
+  double time = 0;
+  int64_t step = 0;
+  int n_components = 1;
+  int64_t n_entities = 0;
+};
+
+struct field_variable {
+  std::string name;
+  int n_components;
+  // ExodusII index of the first component
+  int first_index;
+};
+
+static bool data_section(const std::string &line, field_location &location) {
+  if (line == "$NodeData") {
+    location = field_location::node;
+  } else if (line == "$ElementData") {
+    location = field_location::element;
+  } else if (line == "$ElementNodeData") {
+    location = field_location::element_node;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static std::string end_marker(field_location location) {
+  switch (location) {
+  case field_location::node:
+    return "$EndNodeData";
+  case field_location::element:
+    return "$EndElementData";
+  default:
+    return "$EndElementNodeData";
+  }
+}
+
+static void skip_to(msh2exo::text_scanner &infile, const std::string &marker) {
+  std::string line;
+  while (infile.next_line(line)) {
+    if (line == marker) {
+      return;
+    }
+  }
+  MSH2EXO_READ_CHECK(false,
+                     fmt::format("gmsh reader: string {} not found", marker));
+}
+
+static std::string unquote(const std::string &str) {
+  auto first = str.find_first_not_of(" \t\"");
+  auto last = str.find_last_not_of(" \t\"");
+  return first == std::string::npos ? "" : str.substr(first, last - first + 1);
+}
+
+static data_header read_data_header(msh2exo::text_scanner &infile,
+                                    field_location location) {
+  data_header header;
+  header.location = location;
+
+  std::string line;
+  int n_string_tags;
+  infile >> n_string_tags;
+  infile.next_line(line);
+  for (int i = 0; i < n_string_tags; i++) {
+    infile.next_line(line);
+    if (i == 0) {
+      header.name = unquote(line);
+    }
+  }
+
+  int n_real_tags;
+  infile >> n_real_tags;
+  for (int i = 0; i < n_real_tags; i++) {
+    double value;
+    infile >> value;
+    if (i == 0) {
+      header.time = value;
+    }
+  }
+
+  int n_integer_tags;
+  infile >> n_integer_tags;
+  std::vector<int64_t> integer_tags(n_integer_tags);
+  for (auto &tag : integer_tags) {
+    infile >> tag;
+  }
+  MSH2EXO_READ_CHECK(
+      n_integer_tags >= 3,
+      fmt::format("gmsh reader: data view {} has {} integer tags, expected at "
+                  "least 3",
+                  header.name, n_integer_tags));
+  header.step = integer_tags[0];
+  header.n_components = static_cast<int>(integer_tags[1]);
+  header.n_entities = integer_tags[2];
+  MSH2EXO_READ_CHECK(header.n_components > 0,
+                     fmt::format("gmsh reader: data view {} has no components",
+                                 header.name));
+  if (header.name.empty()) {
+    header.name = "field";
+  }
+  return header;
+}
+
+static std::vector<std::string> component_names(const field_variable &var) {
+  static const char *vector_suffix[] = {"_x", "_y", "_z"};
+  static const char *tensor_suffix[] = {"_xx", "_xy", "_xz", "_yx", "_yy",
+                                        "_yz", "_zx", "_zy", "_zz"};
+  std::vector<std::string> names;
+  for (int c = 0; c < var.n_components; c++) {
+    if (var.n_components == 1) {
+      names.push_back(var.name);
+    } else if (var.n_components == 3) {
+      names.push_back(var.name + vector_suffix[c]);
+    } else if (var.n_components == 9) {
+      names.push_back(var.name + tensor_suffix[c]);
+    } else {
+      names.push_back(fmt::format("{}_{}", var.name, c + 1));
+    }
+  }
+  return names;
+}
+
+static void add_variable(std::vector<field_variable> &vars, int &n_vars,
+                         const data_header &header) {
+  for (const auto &var : vars) {
+    if (var.name == header.name) {
+      MSH2EXO_READ_CHECK(
+          var.n_components == header.n_components,
+          fmt::format("gmsh reader: data view {} changes its number of "
+                      "components",
+                      header.name));
+      return;
+    }
+  }
+  vars.push_back({header.name, header.n_components, n_vars + 1});
+  n_vars += header.n_components;
+}
+
+static const field_variable &find_variable(std::vector<field_variable> &vars,
+                                           const std::string &name) {
+  return *std::find_if(vars.begin(), vars.end(),
+                       [&name](const auto &var) { return var.name == name; });
+}
+
+static void put_variable_names(int exoid, ex_entity_type type,
+                               const std::vector<field_variable> &vars,
+                               int n_vars, const std::string &output) {
+  if (n_vars == 0) {
+    return;
+  }
+  std::vector<std::string> names;
+  for (const auto &var : vars) {
+    auto var_names = component_names(var);
+    names.insert(names.end(), var_names.begin(), var_names.end());
+  }
+  std::vector<char *> name_ptrs;
+  for (auto &name : names) {
+    name_ptrs.push_back(&name[0]);
+  }
+  MSH2EXO_WRITE_CHECK(ex_put_variable_param(exoid, type, n_vars) == EX_NOERR,
+                      fmt::format("{}: ex_put_variable_param failed", output));
+  ex_put_variable_names(exoid, type, n_vars, name_ptrs.data());
+}
+
+int msh2exo::write_gmsh_fields(const std::string &input,
+                               const IntermediateMesh &imesh,
+                               const std::string &output,
+                               const Options &options) {
+  MSH2EXO_CHECK(imesh.node_tags.size() == static_cast<size_t>(imesh.n_nodes) &&
+                    imesh.elem_tags.size() ==
+                        static_cast<size_t>(imesh.n_elements),
+                fmt::format("{}: mesh has no gmsh tags to map data onto",
+                            input));
+
+  // first pass, headers only
+  std::vector<field_variable> nodal_vars;
+  std::vector<field_variable> elem_vars;
+  int n_nodal_vars = 0;
+  int n_elem_vars = 0;
+  std::map<int64_t, double> step_times;
+  int64_t n_sections = 0;
+  progress_stage("scanning fields", 0, "");
+  {
+    auto source = open_input(input);
+    text_scanner infile(source.get());
+    std::string line;
+    field_location location;
+    while (infile.next_line(line)) {
+      if (!data_section(line, location)) {
+        continue;
+      }
+      auto header = read_data_header(infile, location);
+      if (location == field_location::node) {
+        add_variable(nodal_vars, n_nodal_vars, header);
+      } else {
+        add_variable(elem_vars, n_elem_vars, header);
+      }
+      step_times.insert({header.step, header.time});
+      n_sections++;
+      skip_to(infile, end_marker(location));
+    }
+  }
+
+  if (step_times.empty()) {
+    msh2exo::print_if(options.verbose, "{}: no data sections\n", input);
+    return 0;
+  }
+
+  msh2exo::print_if(options.verbose,
+                    "{}: writing {} nodal and {} element variables, {} time "
+                    "steps\n",
+                    output, n_nodal_vars, n_elem_vars, step_times.size());
+
+  int cpu_size = sizeof(double);
+  int io_size = 0;
+  float version;
+  int exoid = ex_open(output.c_str(), EX_WRITE, &cpu_size, &io_size, &version);
+  MSH2EXO_WRITE_CHECK(exoid >= 0,
+                      fmt::format("could not open ExodusII file {}", output));
+
+  put_variable_names(exoid, EX_NODAL, nodal_vars, n_nodal_vars, output);
+  put_variable_names(exoid, EX_ELEM_BLOCK, elem_vars, n_elem_vars, output);
+
+  // gmsh step indices need not be contiguous, ExodusII steps are
+  std::map<int64_t, int> exodus_step;
+  for (const auto &step_time : step_times) {
+    int step = static_cast<int>(exodus_step.size()) + 1;
+    exodus_step[step_time.first] = step;
+    ex_put_time(exoid, step, &step_time.second);
+  }
+
+  msh2exo::tag_lookup node_lookup(imesh.node_tags);
+  msh2exo::tag_lookup elem_lookup(imesh.elem_tags);
+  std::vector<int64_t> block_elem_start(imesh.blocks.size());
+  int64_t elem_offset = 0;
+  for (size_t b = 0; b < imesh.blocks.size(); b++) {
+    block_elem_start[b] = elem_offset;
+    elem_offset += imesh.blocks[b].n_elements;
+  }
+
+  // second pass, one section at a time
+  progress_stage("writing fields", n_sections, "sections");
+  auto source = open_input(input);
+  text_scanner infile(source.get());
+  std::string line;
+  field_location location;
+  std::vector<double> values;
+  std::vector<double> elem_node_values;
+  while (infile.next_line(line)) {
+    if (!data_section(line, location)) {
+      continue;
+    }
+    auto header = read_data_header(infile, location);
+    const int n_comp = header.n_components;
+    const bool nodal = location == field_location::node;
+    const int64_t n_entries = nodal ? imesh.n_nodes : imesh.n_elements;
+    values.assign(n_entries * n_comp, 0.0);
+
+    // entities outside the converted mesh (lower dimensional elements,
+    // merged nodes) are skipped
+    for (int64_t i = 0; i < header.n_entities; i++) {
+      int64_t tag;
+      infile >> tag;
+      int64_t index = nodal ? node_lookup.find(tag) : elem_lookup.find(tag);
+      if (location == field_location::element_node) {
+        int n_elem_nodes;
+        infile >> n_elem_nodes;
+        elem_node_values.resize(n_elem_nodes * n_comp);
+        for (auto &value : elem_node_values) {
+          infile >> value;
+        }
+        if (index >= 0 && n_elem_nodes > 0) {
+          for (int c = 0; c < n_comp; c++) {
+            double sum = 0;
+            for (int n = 0; n < n_elem_nodes; n++) {
+              sum += elem_node_values[n * n_comp + c];
+            }
+            values[c * n_entries + index] = sum / n_elem_nodes;
+          }
+        }
+      } else {
+        for (int c = 0; c < n_comp; c++) {
+          double value;
+          infile >> value;
+          if (index >= 0) {
+            values[c * n_entries + index] = value;
+          }
+        }
+      }
+    }
+    skip_to(infile, end_marker(location));
+
+    int step = exodus_step.at(header.step);
+    if (nodal) {
+      const auto &var = find_variable(nodal_vars, header.name);
+      for (int c = 0; c < n_comp; c++) {
+        ex_put_var(exoid, step, EX_NODAL, var.first_index + c, 1, n_entries,
+                   values.data() + c * n_entries);
+      }
+    } else {
+      const auto &var = find_variable(elem_vars, header.name);
+      for (int c = 0; c < n_comp; c++) {
+        for (size_t b = 0; b < imesh.blocks.size(); b++) {
+          ex_put_var(exoid, step, EX_ELEM_BLOCK, var.first_index + c, b + 1,
+                     imesh.blocks[b].n_elements,
+                     values.data() + c * n_entries + block_elem_start[b]);
+        }
+      }
+    }
+    msh2exo::print_if(options.verbose, "\t {} (step {}, time {})\n",
+                      header.name, step, header.time);
+    progress_add(progress.done, 1);
+  }
+
+  MSH2EXO_WRITE_CHECK(ex_close(exoid) == EX_NOERR,
+                      fmt::format("{}: ex_close failed", output));
+  return n_nodal_vars + n_elem_vars;
+}
@@ -0,0 +1,24 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <string>
+
+#include "intermediate_mesh.hpp"
+#include "options.hpp"
+
+namespace msh2exo {
+// Converts the $NodeData, $ElementData and $ElementNodeData sections of the
+// msh file input to nodal and element variables of the already written
+// ExodusII file output. A first pass over the input collects the views and
+// time steps from the section headers, a second pass streams every section
+// straight into the output through the node and element tags of imesh, so
+// only one section is held in memory at a time. $ElementNodeData values are
+// averaged over the element nodes. Returns the number of variables written.
+int write_gmsh_fields(const std::string &input, const IntermediateMesh &imesh,
+                      const std::string &output, const Options &options);
+} // namespace msh2exo
@@ -9,12 +9,20 @@
 #include <cassert>
 #include <fmt/format.h>
 #include <fstream>
+#include <istream>
 #include <limits>
 #include <map>
 #include <numeric>
 #include <set>
 
+#include "arena.hpp"
+#include "compressed_input.hpp"
+#include "dense_bitset.hpp"
 #include "gmsh_reader.hpp"
+#include "parallel.hpp"
+#include "progress.hpp"
+#include "tag_lookup.hpp"
+#include "text_scanner.hpp"
 #include "util.hpp"
 
 const std::map<gmsh_element_type, msh2exo::element_type>
@@ -44,11 +52,14 @@ const std::map<gmsh_element_type, int> msh2exo::gmsh_type_n_nodes = {
 const std::map<gmsh_element_type, std::vector<int>>
     msh2exo::gmsh_type_node_order_map{
         {gmsh_element_type::tet10, {0, 1, 2, 3, 4, 5, 6, 7, 9, 8}},
+        {gmsh_element_type::hex27,
+         {0,  1,  2,  3,  4,  5,  6,  7,  8,  11, 13, 9,  10, 12,
+          14, 15, 16, 18, 19, 17, 26, 20, 25, 22, 23, 21, 24}},
     };
 
-static bool find_line(std::ifstream &fs, const std::string &st) {
+static bool find_line(msh2exo::text_scanner &fs, const std::string &st) {
   std::string linest;
-  while (std::getline(fs, linest)) {
+  while (fs.next_line(linest)) {
     if (linest == st) {
       return true;
     }
@@ -56,17 +67,17 @@ static bool find_line(std::ifstream &fs, const std::string &st) {
   return false;
 }
 
-static void seek_string(std::ifstream &fs, const std::string &sv) {
-  MSH2EXO_CHECK(find_line(fs, sv),
-                fmt::format("gmsh reader: string {} not found", sv));
+static void seek_string(msh2exo::text_scanner &fs, const std::string &sv) {
+  MSH2EXO_READ_CHECK(find_line(fs, sv),
+                     fmt::format("gmsh reader: string {} not found", sv));
 }
 
 static void check_version(double version) {
-  MSH2EXO_CHECK(version > 4.09, "Expected Gmsh file version >= 4.1");
+  MSH2EXO_READ_CHECK(version > 4.09, "Expected Gmsh file version >= 4.1");
 }
 
 static void check_file_type(int file_type) {
-  MSH2EXO_CHECK(file_type == 0, "Expected ASCII Gmsh msh file");
+  MSH2EXO_READ_CHECK(file_type == 0, "Expected ASCII Gmsh msh file");
 }
 
 struct gmsh_physical {
@@ -75,28 +86,46 @@ struct gmsh_physical {
   std::string name;
 };
 
-std::vector<gmsh_physical> read_physical_names(std::ifstream &infile) {
-  seek_string(infile, "$PhysicalNames");
-
+std::vector<gmsh_physical> read_physical_names(msh2exo::text_scanner &infile) {
   int n_names;
   infile >> n_names;
   std::vector<gmsh_physical> phys_names(n_names);
 
+  // names are quoted and may contain spaces, the quotes are not part of
+  // the name (the Gmsh SDK returns them bare)
+  std::string line;
   for (auto i = 0; i < n_names; i++) {
-    infile >> phys_names[i].dim >> phys_names[i].tag >> phys_names[i].name;
+    infile >> phys_names[i].dim >> phys_names[i].tag;
+    infile.next_line(line);
+    auto first = line.find('"');
+    auto last = line.rfind('"');
+    if (first != std::string::npos && last > first) {
+      phys_names[i].name = line.substr(first + 1, last - first - 1);
+    } else {
+      auto begin = line.find_first_not_of(" \t\r");
+      auto end = line.find_last_not_of(" \t\r");
+      phys_names[i].name =
+          begin == std::string::npos ? "" : line.substr(begin, end - begin + 1);
+    }
   }
   seek_string(infile, "$EndPhysicalNames");
   return phys_names;
 }
 
+// the reading stage counts input bytes
+static void report_offset(const msh2exo::text_scanner &infile) {
+  auto offset = static_cast<int64_t>(infile.offset());
+  msh2exo::progress.bytes_read.store(offset, std::memory_order_relaxed);
+  msh2exo::progress.done.store(offset, std::memory_order_relaxed);
+}
+
 struct gmsh_node {
   size_t id;
   std::array<double, 3> location;
 };
 
-static std::vector<gmsh_node> read_nodes(std::ifstream &infile) {
-  seek_string(infile, "$Nodes");
-
+static msh2exo::arena_vector<gmsh_node>
+read_nodes(msh2exo::text_scanner &infile, msh2exo::arena &pool) {
   size_t n_entity_blocks;
   size_t n_nodes;
   size_t min_node_tag;
@@ -104,7 +133,8 @@ static std::vector<gmsh_node> read_nodes(std::ifstream &infile) {
 
   infile >> n_entity_blocks >> n_nodes >> min_node_tag >> max_node_tag;
 
-  std::vector<gmsh_node> nodes(n_nodes);
+  msh2exo::arena_vector<gmsh_node> nodes(
+      n_nodes, gmsh_node(), msh2exo::arena_allocator<gmsh_node>(pool));
   size_t node_index = 0;
 
   for (size_t ent = 0; ent < n_entity_blocks; ent++) {
@@ -119,10 +149,16 @@ static std::vector<gmsh_node> read_nodes(std::ifstream &infile) {
       infile >> nodes[index].id;
     }
 
-    for (auto index = node_index; index < (node_index + n_nodes_in_block);
-         index++) {
-      infile >> nodes[index].location[0] >> nodes[index].location[1] >>
-          nodes[index].location[2];
+    const size_t chunk = msh2exo::progress_chunk;
+    auto block_end = node_index + n_nodes_in_block;
+    for (auto first = node_index; first < block_end; first += chunk) {
+      auto last = std::min(block_end, first + chunk);
+      for (auto index = first; index < last; index++) {
+        infile >> nodes[index].location[0] >> nodes[index].location[1] >>
+            nodes[index].location[2];
+      }
+      msh2exo::progress_add(msh2exo::progress.nodes_read, last - first);
+      report_offset(infile);
     }
 
     node_index += n_nodes_in_block;
@@ -154,25 +190,32 @@ int msh2exo::n_nodes_from_type(gmsh_element_type type) {
   case gmsh_element_type::point1:
     return 1;
   default:
-    throw std::runtime_error("Unknown element type");
+    throw msh2exo::read_error("Unknown element type");
   }
 }
 
 struct gmsh_element_group {
-  int dim;
-  int tag;
-  gmsh_element_type type;
-  std::vector<size_t> elem_ids;
-  std::vector<size_t> connectivity;
+  explicit gmsh_element_group(msh2exo::arena &pool)
+      : elem_ids(msh2exo::arena_allocator<size_t>(pool)),
+        connectivity(msh2exo::arena_allocator<size_t>(pool)) {}
+
+  int dim = 0;
+  int tag = 0;
+  gmsh_element_type type = gmsh_element_type::line2;
+  msh2exo::arena_vector<size_t> elem_ids;
+  msh2exo::arena_vector<size_t> connectivity;
 };
 
 struct gmsh_entity {
+  explicit gmsh_entity(msh2exo::arena &pool)
+      : physical_tags(msh2exo::arena_allocator<size_t>(pool)) {}
+
   int dim;
   int tag;
-  std::vector<size_t> physical_tags;
+  msh2exo::arena_vector<size_t> physical_tags;
 };
 
-static void read_point_entity(std::ifstream &infile, gmsh_entity &ent) {
+static void read_point_entity(msh2exo::text_scanner &infile, gmsh_entity &ent) {
   double x, y, z;
   size_t n_physical_tags;
   infile >> ent.tag >> x >> y >> z >> n_physical_tags;
@@ -182,7 +225,7 @@ static void read_point_entity(std::ifstream &infile, gmsh_entity &ent) {
   }
 }
 
-static void read_entity(std::ifstream &infile, gmsh_entity &ent) {
+static void read_entity(msh2exo::text_scanner &infile, gmsh_entity &ent) {
   double min_x, min_y, min_z;
   double max_x, max_y, max_z;
   size_t n_physical_tags;
@@ -201,14 +244,15 @@ static void read_entity(std::ifstream &infile, gmsh_entity &ent) {
   }
 }
 
-static std::vector<gmsh_entity> read_entities(std::ifstream &infile) {
-  seek_string(infile, "$Entities");
+static std::vector<gmsh_entity> read_entities(msh2exo::text_scanner &infile,
+                                              msh2exo::arena &pool) {
   std::vector<gmsh_entity> entities;
 
   size_t n_points, n_curves, n_surfaces, n_volumes;
   infile >> n_points >> n_curves >> n_surfaces >> n_volumes;
 
-  entities.resize(n_points + n_curves + n_surfaces + n_volumes);
+  entities.resize(n_points + n_curves + n_surfaces + n_volumes,
+                  gmsh_entity(pool));
 
   for (size_t i = 0; i < n_points; i++) {
     read_point_entity(infile, entities[i]);
@@ -237,9 +281,8 @@ static std::vector<gmsh_entity> read_entities(std::ifstream &infile) {
   return entities;
 }
 
-static std::vector<gmsh_element_group> read_elements(std::ifstream &infile) {
-  seek_string(infile, "$Elements");
-
+static std::vector<gmsh_element_group>
+read_elements(msh2exo::text_scanner &infile, msh2exo::arena &pool) {
   size_t n_entity_blocks;
   size_t n_elements;
   size_t min_element_tag;
@@ -247,7 +290,8 @@ static std::vector<gmsh_element_group> read_elements(std::ifstream &infile) {
 
   infile >> n_entity_blocks >> n_elements >> min_element_tag >> max_element_tag;
 
-  std::vector<gmsh_element_group> element_groups(n_entity_blocks);
+  std::vector<gmsh_element_group> element_groups(n_entity_blocks,
+                                                 gmsh_element_group(pool));
 
   for (size_t ent = 0; ent < n_entity_blocks; ent++) {
     size_t element_type;
@@ -256,56 +300,117 @@ static std::vector<gmsh_element_group> read_elements(std::ifstream &infile) {
         element_type >> n_elements_in_block;
     element_groups[ent].type = static_cast<gmsh_element_type>(element_type);
 
+    auto type_it = msh2exo::gmsh_type_n_nodes.find(element_groups[ent].type);
+    MSH2EXO_READ_CHECK(type_it != msh2exo::gmsh_type_n_nodes.end(),
+                       fmt::format("gmsh reader: unsupported element type {} "
+                                   "at {}",
+                                   element_type, infile.location()));
     element_groups[ent].elem_ids.resize(n_elements_in_block);
-    int n_nodes = msh2exo::gmsh_type_n_nodes.at(element_groups[ent].type);
+    int n_nodes = type_it->second;
     element_groups[ent].connectivity.resize(n_elements_in_block * n_nodes);
-    for (size_t index = 0; index < n_elements_in_block; index++) {
-      infile >> element_groups[ent].elem_ids[index];
-      for (int i = 0; i < n_nodes; i++) {
-        infile >> element_groups[ent].connectivity[index * n_nodes + i];
+    const size_t chunk = msh2exo::progress_chunk;
+    for (size_t first = 0; first < n_elements_in_block; first += chunk) {
+      auto last = std::min(n_elements_in_block, first + chunk);
+      for (size_t index = first; index < last; index++) {
+        infile >> element_groups[ent].elem_ids[index];
+        for (int i = 0; i < n_nodes; i++) {
+          infile >> element_groups[ent].connectivity[index * n_nodes + i];
+        }
       }
+      msh2exo::progress_add(msh2exo::progress.elements_read, last - first);
+      report_offset(infile);
     }
   }
   seek_string(infile, "$EndElements");
   return element_groups;
 }
 
-msh2exo::IntermediateMesh msh2exo::read_gmsh_file(std::string filepath) {
-  std::ifstream infile(filepath);
-
-  seek_string(infile, "$MeshFormat");
-  double version;
-  int file_type;
-  int data_size;
-
-  infile >> version >> file_type >> data_size;
-
-  check_version(version);
-  check_file_type(file_type);
-
-  seek_string(infile, "$EndMeshFormat");
-
-  auto physical_names = read_physical_names(infile);
+// index of gmsh node tag, a node of element elem_id
+static int64_t node_index(const msh2exo::tag_lookup &node_lookup, size_t tag,
+                          size_t elem_id) {
+  auto node = node_lookup.find(static_cast<int64_t>(tag));
+  MSH2EXO_READ_CHECK(node >= 0,
+                     fmt::format("gmsh reader: element {} references node {}, "
+                                 "which is not in $Nodes",
+                                 elem_id, tag));
+  return node;
+}
 
-  auto entities = read_entities(infile);
+// entities of physical group tag
+static const std::set<int> &
+physical_entities(const std::map<int, std::set<int>> &phys_ents, int tag) {
+  auto ent_set = phys_ents.find(tag);
+  MSH2EXO_READ_CHECK(ent_set != phys_ents.end(),
+                     fmt::format("Could not find physical tag {} in mesh "
+                                 "entities, check msh file",
+                                 tag));
+  return ent_set->second;
+}
 
+// fills imesh in place, reusing the capacity of its arrays
+static void read_gmsh(msh2exo::text_scanner &infile,
+                      msh2exo::IntermediateMesh &imesh) {
+  // Sections are parsed as they arrive, strictly front to back, so the
+  // input can be a pipe. Each one is kept until the mesh is assembled from
+  // all of them, sections not needed are skipped.
+  bool have_format = false;
+  bool have_names = false;
+  bool have_entities = false;
+  bool have_nodes = false;
+  bool have_elements = false;
+  std::vector<gmsh_physical> physical_names;
+  // reader temporaries live in one arena per phase, each released as soon
+  // as its data has been copied into the mesh
   std::map<int, std::set<int>> phys_ents;
-
-  for (auto ent : entities) {
-    for (auto phys_tag : ent.physical_tags) {
-      if (phys_ents.find(phys_tag) == phys_ents.end()) {
-        assert(static_cast<int>(phys_tag) < std::numeric_limits<int>::max());
-        phys_ents.insert({static_cast<int>(phys_tag), {ent.tag}});
-      } else {
-        assert(static_cast<int>(phys_tag) < std::numeric_limits<int>::max());
-        phys_ents[static_cast<int>(phys_tag)].insert(ent.tag);
+  msh2exo::arena node_pool;
+  msh2exo::arena_vector<gmsh_node> nodes(
+      msh2exo::arena_allocator<gmsh_node>{node_pool});
+  msh2exo::arena element_pool;
+  std::vector<gmsh_element_group> element_groups;
+
+  std::string section;
+  while (!(have_format && have_names && have_entities && have_nodes &&
+           have_elements) &&
+         infile.next_line(section)) {
+    if (section == "$MeshFormat") {
+      double version;
+      int file_type;
+      int data_size;
+      infile >> version >> file_type >> data_size;
+      check_version(version);
+      check_file_type(file_type);
+      seek_string(infile, "$EndMeshFormat");
+      have_format = true;
+    } else if (section == "$PhysicalNames") {
+      physical_names = read_physical_names(infile);
+      have_names = true;
+    } else if (section == "$Entities") {
+      msh2exo::arena entity_pool;
+      auto entities = read_entities(infile, entity_pool);
+      for (const auto &ent : entities) {
+        for (auto phys_tag : ent.physical_tags) {
+          assert(static_cast<int>(phys_tag) < std::numeric_limits<int>::max());
+          phys_ents[static_cast<int>(phys_tag)].insert(ent.tag);
+        }
       }
+      have_entities = true;
+    } else if (section == "$Nodes") {
+      nodes = read_nodes(infile, node_pool);
+      have_nodes = true;
+    } else if (section == "$Elements") {
+      element_groups = read_elements(infile, element_pool);
+      have_elements = true;
+    } else if (section.size() > 1 && section[0] == '$') {
+      seek_string(infile, "$End" + section.substr(1));
     }
   }
-
-  auto nodes = read_nodes(infile);
-
-  auto element_groups = read_elements(infile);
+  MSH2EXO_READ_CHECK(have_format,
+                     "gmsh reader: string $MeshFormat not found");
+  MSH2EXO_READ_CHECK(have_names,
+                     "gmsh reader: string $PhysicalNames not found");
+  MSH2EXO_READ_CHECK(have_entities, "gmsh reader: string $Entities not found");
+  MSH2EXO_READ_CHECK(have_nodes, "gmsh reader: string $Nodes not found");
+  MSH2EXO_READ_CHECK(have_elements, "gmsh reader: string $Elements not found");
 
   // assume largest dim represents blocks for now
   auto max_dim = std::accumulate(
@@ -320,102 +425,387 @@ msh2exo::IntermediateMesh msh2exo::read_gmsh_file(std::string filepath) {
       std::count_if(physical_names.begin(), physical_names.end(),
                     [max_dim](auto &el) { return max_dim > el.dim; });
 
-  IntermediateMesh imesh;
   imesh.dim = max_dim;
   imesh.n_blocks = n_blocks;
   imesh.blocks.resize(n_blocks);
   imesh.boundaries.resize(n_boundaries);
+  imesh.elem_tags.clear();
   imesh.n_nodes = nodes.size();
   imesh.coords.resize(imesh.n_nodes * 3);
 
-  std::map<size_t, size_t> node_map;
-  for (size_t i = 0; i < nodes.size(); i++) {
-    node_map.insert({nodes[i].id, i});
-    for (int j = 0; j < 3; j++) {
-      imesh.coords[i * 3 + j] = nodes[i].location[j];
+  int64_t n_block_elements = 0;
+  for (const auto &e_group : element_groups) {
+    if (e_group.dim == max_dim) {
+      n_block_elements += e_group.elem_ids.size();
     }
   }
+  msh2exo::progress_stage("building blocks", n_block_elements, "elements");
+
+  imesh.node_tags.resize(imesh.n_nodes);
+  // written in the chunks the later parallel stages read
+  msh2exo::parallel_for_chunks(
+      0, imesh.n_nodes, [&](int64_t begin, int64_t end, int) {
+        for (int64_t i = begin; i < end; i++) {
+          imesh.node_tags[i] = nodes[i].id;
+          for (int j = 0; j < 3; j++) {
+            imesh.coords[i * 3 + j] = nodes[i].location[j];
+          }
+        }
+      });
+  msh2exo::arena_vector<gmsh_node>(
+      msh2exo::arena_allocator<gmsh_node>(node_pool))
+      .swap(nodes);
+  node_pool.release();
+  msh2exo::tag_lookup node_lookup(imesh.node_tags);
+
+  // maps the gmsh node ids of a group into conn from offset on, in Exodus
+  // node order, in parallel (lookups only read node_lookup) and a progress
+  // chunk at a time
+  auto remap_connectivity = [&](const gmsh_element_group &e_group,
+                                int n_nodes,
+                                msh2exo::mesh_vector<int64_t> &conn,
+                                size_t offset) {
+    std::vector<int> order(n_nodes);
+    std::iota(order.begin(), order.end(), 0);
+    auto reorder = msh2exo::gmsh_type_node_order_map.find(e_group.type);
+    if (reorder != msh2exo::gmsh_type_node_order_map.end()) {
+      order = reorder->second;
+    }
+    auto remap = [&](int64_t begin, int64_t end, int) {
+      for (int64_t first = begin; first < end;
+           first += msh2exo::progress_chunk) {
+        int64_t last = std::min(end, first + msh2exo::progress_chunk);
+        for (int64_t j = first; j < last; j++) {
+          for (int k = 0; k < n_nodes; k++) {
+            conn[offset + j * n_nodes + k] = node_index(
+                node_lookup, e_group.connectivity[j * n_nodes + order[k]],
+                e_group.elem_ids[j]);
+          }
+        }
+        msh2exo::progress_add(msh2exo::progress.elements_remapped,
+                              last - first);
+        msh2exo::progress_add(msh2exo::progress.done, last - first);
+      }
+    };
+    msh2exo::parallel_for_chunks(0, e_group.elem_ids.size(), remap);
+  };
+
+  // element type of a block from the groups it is made of
+  auto block_type = [](const gmsh_element_group &e_group,
+                       const gmsh_physical &physical) {
+    auto type = msh2exo::gmsh_type_to_elem_type.find(e_group.type);
+    MSH2EXO_READ_CHECK(
+        type != msh2exo::gmsh_type_to_elem_type.end(),
+        fmt::format("gmsh reader: element type {} of physical group {} tag {} "
+                    "can not form a block",
+                    static_cast<int>(e_group.type), physical.name,
+                    physical.tag));
+    return type->second;
+  };
 
   size_t block_index = 0;
-  size_t boundary_index = 0;
+  std::vector<const gmsh_physical *> boundary_physicals;
   imesh.n_elements = 0;
-  for (auto physical : physical_names) {
+  for (const auto &physical : physical_names) {
     if (physical.dim == max_dim) {
       bool block_set = false;
-      try {
-        auto &ent_set = phys_ents.at(physical.tag);
-        for (auto e_group : element_groups) {
-          if (e_group.dim == physical.dim &&
-              ent_set.find(e_group.tag) != ent_set.end()) {
-
-            if (!block_set) {
-              imesh.blocks[block_index].n_elements = e_group.elem_ids.size();
-              imesh.blocks[block_index].type =
-                  msh2exo::gmsh_type_to_elem_type.at(e_group.type);
-              int n_nodes =
-                  msh2exo::elem_info_map.at(imesh.blocks[block_index].type)
-                      .n_nodes;
-              imesh.blocks[block_index].name = physical.name;
-              imesh.blocks[block_index].connectivity.resize(
-                  imesh.blocks[block_index].n_elements * n_nodes);
-              for (int64_t i = 0;
-                   i < (imesh.blocks[block_index].n_elements * n_nodes); i++) {
-                imesh.blocks[block_index].connectivity[i] =
-                    node_map.at(e_group.connectivity[i]);
-              }
-              block_set = true;
-            } else {
-              MSH2EXO_CHECK(
-                  msh2exo::gmsh_type_to_elem_type.at(e_group.type) ==
-                      imesh.blocks[block_index].type,
-                  fmt::format("More than one element type found in physical "
-                              "group {} tag {}",
-                              physical.name, physical.tag));
-              size_t offset = imesh.blocks[block_index].n_elements;
-              imesh.blocks[block_index].n_elements += e_group.elem_ids.size();
-              int n_nodes =
-                  msh2exo::elem_info_map.at(imesh.blocks[block_index].type)
-                      .n_nodes;
-              imesh.blocks[block_index].connectivity.resize(
-                  imesh.blocks[block_index].n_elements * n_nodes);
-              for (int64_t i = 0;
-                   i < (e_group.elem_ids.size() * n_nodes); i++) {
-                imesh.blocks[block_index].connectivity[offset * n_nodes + i] =
-                    node_map.at(e_group.connectivity[i]);
-              }
-            }
+      imesh.blocks[block_index].n_elements = 0;
+      imesh.blocks[block_index].connectivity.clear();
+      const auto &ent_set = physical_entities(phys_ents, physical.tag);
+      for (const auto &e_group : element_groups) {
+        if (e_group.dim == physical.dim &&
+            ent_set.find(e_group.tag) != ent_set.end()) {
+
+          if (!block_set) {
+            imesh.blocks[block_index].n_elements = e_group.elem_ids.size();
+            imesh.blocks[block_index].type = block_type(e_group, physical);
+            int n_nodes =
+                msh2exo::elem_info_map.at(imesh.blocks[block_index].type)
+                    .n_nodes;
+            imesh.blocks[block_index].name = physical.name;
+            imesh.blocks[block_index].connectivity.resize(
+                imesh.blocks[block_index].n_elements * n_nodes);
+            remap_connectivity(e_group, n_nodes,
+                               imesh.blocks[block_index].connectivity, 0);
+            imesh.elem_tags.insert(imesh.elem_tags.end(),
+                                   e_group.elem_ids.begin(),
+                                   e_group.elem_ids.end());
+            block_set = true;
+          } else {
+            MSH2EXO_READ_CHECK(
+                block_type(e_group, physical) ==
+                    imesh.blocks[block_index].type,
+                fmt::format("More than one element type found in physical "
+                            "group {} tag {}",
+                            physical.name, physical.tag));
+            size_t offset = imesh.blocks[block_index].n_elements;
+            imesh.blocks[block_index].n_elements += e_group.elem_ids.size();
+            int n_nodes =
+                msh2exo::elem_info_map.at(imesh.blocks[block_index].type)
+                    .n_nodes;
+            imesh.blocks[block_index].connectivity.resize(
+                imesh.blocks[block_index].n_elements * n_nodes);
+            remap_connectivity(e_group, n_nodes,
+                               imesh.blocks[block_index].connectivity,
+                               offset * n_nodes);
+            imesh.elem_tags.insert(imesh.elem_tags.end(),
+                                   e_group.elem_ids.begin(),
+                                   e_group.elem_ids.end());
           }
         }
-        imesh.n_elements += imesh.blocks[block_index].n_elements;
-        block_index++;
-      } catch (std::out_of_range & e) {
-        MSH2EXO_ERROR(fmt::format("{}\n Could not find physical tag {} in mesh entities, check msh file", e.what(), physical.tag));
       }
+      imesh.n_elements += imesh.blocks[block_index].n_elements;
+      block_index++;
     } else {
-      try {
-
-        auto &ent_set = phys_ents.at(physical.tag);
-        std::set<size_t> ss_nodes;
-        for (auto e_group : element_groups) {
-          if (e_group.dim == physical.dim &&
-              ent_set.find(e_group.tag) != ent_set.end()) {
-            for (size_t i = 0; i < e_group.connectivity.size(); i++) {
-              ss_nodes.insert(node_map.at(e_group.connectivity[i]));
+      boundary_physicals.push_back(&physical);
+    }
+  }
+
+  // boundaries are independent, each thread collects nodes in its own
+  // bitset and reads them back sorted
+  std::vector<msh2exo::dense_bitset> thread_marks(msh2exo::thread_count());
+  auto build_boundaries = [&](int64_t begin, int64_t end, int thread) {
+    auto &marks = thread_marks[thread];
+    marks.resize(imesh.n_nodes);
+    for (int64_t b = begin; b < end; b++) {
+      const auto &physical = *boundary_physicals[b];
+      auto &bound = imesh.boundaries[b];
+      const auto &ent_set = physical_entities(phys_ents, physical.tag);
+      for (const auto &e_group : element_groups) {
+        if (e_group.dim == physical.dim &&
+            ent_set.find(e_group.tag) != ent_set.end()) {
+          int n_nodes = msh2exo::gmsh_type_n_nodes.at(e_group.type);
+          for (size_t j = 0; j < e_group.elem_ids.size(); j++) {
+            for (int k = 0; k < n_nodes; k++) {
+              marks.set(node_index(node_lookup,
+                                   e_group.connectivity[j * n_nodes + k],
+                                   e_group.elem_ids[j]));
             }
           }
         }
-        imesh.boundaries[boundary_index].name = physical.name;
-        imesh.boundaries[boundary_index].tag = physical.tag;
-        imesh.boundaries[boundary_index].nodes.resize(ss_nodes.size());
-        std::copy(ss_nodes.begin(), ss_nodes.end(),
-                  imesh.boundaries[boundary_index].nodes.begin());
-        boundary_index++;
-
-      } catch (std::out_of_range & e) {
-        MSH2EXO_ERROR(fmt::format("{}\n Could not find physical tag {} in mesh entities, check msh file", e.what(), physical.tag));
       }
+      bound.name = physical.name;
+      bound.tag = physical.tag;
+      bound.nodes.clear();
+      bound.side_elems.clear();
+      bound.side_ids.clear();
+      marks.drain_sorted(bound.nodes);
     }
+  };
+  msh2exo::parallel_for_chunks(0, boundary_physicals.size(), build_boundaries,
+                               1);
+  std::vector<gmsh_element_group>().swap(element_groups);
+  element_pool.release();
+}
+
+msh2exo::IntermediateMesh msh2exo::read_gmsh_file(std::string filepath) {
+  IntermediateMesh imesh;
+  read_gmsh_file(filepath, imesh);
+  return imesh;
+}
+
+void msh2exo::read_gmsh_file(const std::string &filepath,
+                             IntermediateMesh &imesh) {
+  // the decompressed size and the size of a stream are not known up front
+  int64_t total = 0;
+  if (!is_stream_input(filepath) &&
+      detect_compression(filepath) == compression::none) {
+    std::ifstream in(filepath, std::ios::binary | std::ios::ate);
+    total = in ? static_cast<int64_t>(in.tellg()) : 0;
   }
+  progress_stage("reading", total, "B");
+  auto source = msh2exo::open_input(filepath);
+  msh2exo::text_scanner infile(source.get());
+  read_gmsh(infile, imesh);
+}
+
+msh2exo::IntermediateMesh msh2exo::read_gmsh_stream(std::istream &input) {
+  progress_stage("reading", 0, "B");
+  msh2exo::text_scanner infile(input.rdbuf());
+  IntermediateMesh imesh;
+  read_gmsh(infile, imesh);
+  return imesh;
+}
 
+msh2exo::IntermediateMesh msh2exo::read_gmsh_buffer(const char *data,
+                                                   size_t size) {
+  progress_stage("reading", size, "B");
+  msh2exo::text_scanner infile(data, size);
+  IntermediateMesh imesh;
+  read_gmsh(infile, imesh);
   return imesh;
 }
+
+struct gmsh_entity_block {
+  int dim;
+  int tag;
+  gmsh_element_type type;
+  int64_t n_elements;
+};
+
+// every node takes two lines, its tag and then its coordinates
+static int64_t skip_nodes(msh2exo::text_scanner &infile) {
+  size_t n_entity_blocks;
+  size_t n_nodes;
+  size_t min_node_tag;
+  size_t max_node_tag;
+  infile >> n_entity_blocks >> n_nodes >> min_node_tag >> max_node_tag;
+
+  for (size_t ent = 0; ent < n_entity_blocks; ent++) {
+    int dim;
+    int tag;
+    int parametric;
+    size_t n_nodes_in_block;
+    infile >> dim >> tag >> parametric >> n_nodes_in_block;
+    MSH2EXO_READ_CHECK(infile.skip_lines(1 + 2 * n_nodes_in_block),
+                       "gmsh reader: unexpected end of input in $Nodes");
+  }
+  seek_string(infile, "$EndNodes");
+  return n_nodes;
+}
+
+// every element takes one line
+static std::vector<gmsh_entity_block>
+skip_elements(msh2exo::text_scanner &infile) {
+  size_t n_entity_blocks;
+  size_t n_elements;
+  size_t min_element_tag;
+  size_t max_element_tag;
+  infile >> n_entity_blocks >> n_elements >> min_element_tag >> max_element_tag;
+
+  std::vector<gmsh_entity_block> blocks(n_entity_blocks);
+  for (auto &block : blocks) {
+    size_t element_type;
+    size_t n_elements_in_block;
+    infile >> block.dim >> block.tag >> element_type >> n_elements_in_block;
+    block.type = static_cast<gmsh_element_type>(element_type);
+    block.n_elements = n_elements_in_block;
+    MSH2EXO_READ_CHECK(msh2exo::gmsh_type_n_nodes.count(block.type) != 0,
+                       fmt::format("gmsh reader: unsupported element type {} "
+                                   "at {}",
+                                   element_type, infile.location()));
+    MSH2EXO_READ_CHECK(infile.skip_lines(1 + n_elements_in_block),
+                       "gmsh reader: unexpected end of input in $Elements");
+  }
+  seek_string(infile, "$EndElements");
+  return blocks;
+}
+
+// Heap of the arrays read_gmsh and write_mesh hold at the same time: the
+// node records, the mesh nodes and all element records while the nodes are
+// copied, the same with the node tag lookup and the block connectivity in
+// place of the node records while it is remapped, and the mesh with the
+// writer buffers of the largest block while writing.
+static int64_t
+estimate_peak_bytes(const msh2exo::gmsh_file_info &info,
+                    const std::vector<gmsh_entity_block> &blocks,
+                    const std::map<int, std::set<int>> &phys_ents) {
+  int64_t n_nodes = info.n_nodes;
+  int64_t record_bytes = 0;
+  for (const auto &block : blocks) {
+    record_bytes += block.n_elements * sizeof(size_t) *
+                    (1 + msh2exo::gmsh_type_n_nodes.at(block.type));
+  }
+  int64_t conn_bytes = 0;
+  int64_t largest_conn = 0;
+  for (const auto &physical : info.physicals) {
+    if (physical.dim == info.dim && phys_ents.count(physical.tag) != 0) {
+      int64_t n_entries = physical.n_elements * physical.n_nodes_per_element;
+      conn_bytes += (n_entries + physical.n_elements) * sizeof(int64_t);
+      largest_conn = std::max(largest_conn, n_entries);
+    }
+  }
+  // coordinates and node tags
+  int64_t mesh_node_bytes = n_nodes * 4 * sizeof(double);
+  // the tag lookup is dense for the contiguous tags Gmsh writes
+  int64_t lookup_bytes = n_nodes * sizeof(int64_t);
+  int64_t reading =
+      mesh_node_bytes + record_bytes +
+      std::max(static_cast<int64_t>(n_nodes * sizeof(gmsh_node)),
+               lookup_bytes + conn_bytes);
+  int64_t writing = mesh_node_bytes + conn_bytes +
+                    n_nodes * 3 * sizeof(double) + largest_conn * sizeof(int);
+  return std::max(reading, writing);
+}
+
+msh2exo::gmsh_file_info msh2exo::read_gmsh_info(const std::string &filepath) {
+  auto source = msh2exo::open_input(filepath);
+  msh2exo::text_scanner infile(source.get());
+
+  gmsh_file_info info;
+  bool have_format = false;
+  bool have_names = false;
+  bool have_entities = false;
+  bool have_nodes = false;
+  bool have_elements = false;
+  std::vector<gmsh_physical> physical_names;
+  std::map<int, std::set<int>> phys_ents;
+  std::vector<gmsh_entity_block> blocks;
+
+  std::string section;
+  while (!(have_format && have_names && have_entities && have_nodes &&
+           have_elements) &&
+         infile.next_line(section)) {
+    if (section == "$MeshFormat") {
+      int file_type;
+      int data_size;
+      infile >> info.version >> file_type >> data_size;
+      check_version(info.version);
+      check_file_type(file_type);
+      seek_string(infile, "$EndMeshFormat");
+      have_format = true;
+    } else if (section == "$PhysicalNames") {
+      physical_names = read_physical_names(infile);
+      have_names = true;
+    } else if (section == "$Entities") {
+      msh2exo::arena entity_pool;
+      for (const auto &ent : read_entities(infile, entity_pool)) {
+        for (auto phys_tag : ent.physical_tags) {
+          phys_ents[static_cast<int>(phys_tag)].insert(ent.tag);
+        }
+      }
+      have_entities = true;
+    } else if (section == "$Nodes") {
+      info.n_nodes = skip_nodes(infile);
+      have_nodes = true;
+    } else if (section == "$Elements") {
+      blocks = skip_elements(infile);
+      have_elements = true;
+    } else if (section.size() > 1 && section[0] == '$') {
+      seek_string(infile, "$End" + section.substr(1));
+    }
+  }
+  MSH2EXO_READ_CHECK(have_format,
+                     "gmsh reader: string $MeshFormat not found");
+  MSH2EXO_READ_CHECK(have_names,
+                     "gmsh reader: string $PhysicalNames not found");
+  MSH2EXO_READ_CHECK(have_entities, "gmsh reader: string $Entities not found");
+  MSH2EXO_READ_CHECK(have_nodes, "gmsh reader: string $Nodes not found");
+  MSH2EXO_READ_CHECK(have_elements, "gmsh reader: string $Elements not found");
+
+  info.dim = 0;
+  for (const auto &physical : physical_names) {
+    info.dim = std::max(info.dim, physical.dim);
+  }
+  info.n_elements = 0;
+  for (const auto &block : blocks) {
+    info.n_elements += block.n_elements;
+  }
+  // grouped the way read_gmsh assembles blocks and boundaries
+  for (const auto &physical : physical_names) {
+    gmsh_physical_info group{physical.dim, physical.tag, physical.name, 0, 0};
+    auto ent_set = phys_ents.find(physical.tag);
+    if (ent_set != phys_ents.end()) {
+      for (const auto &block : blocks) {
+        if (block.dim == physical.dim &&
+            ent_set->second.count(block.tag) != 0) {
+          group.n_elements += block.n_elements;
+          group.n_nodes_per_element = gmsh_type_n_nodes.at(block.type);
+        }
+      }
+    }
+    info.physicals.push_back(group);
+  }
+  info.estimated_peak_bytes = estimate_peak_bytes(info, blocks, phys_ents);
+  return info;
+}
@@ -5,8 +5,12 @@
 // See the LICENSE file for license information.
 
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <istream>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "intermediate_mesh.hpp"
 
@@ -26,11 +30,41 @@ enum class gmsh_element_type {
 };
 
 namespace msh2exo {
+struct gmsh_physical_info {
+  int dim;
+  int tag;
+  std::string name;
+  int64_t n_elements;
+  // 0 when the group has no elements
+  int n_nodes_per_element;
+};
+
+// Counts of a msh file taken from its section and entity block headers, the
+// node and element records in between are skipped without being parsed
+struct gmsh_file_info {
+  double version;
+  // dimension of the blocks, the highest of the physical groups
+  int dim;
+  int64_t n_nodes;
+  // all elements of the file, including those in no physical group
+  int64_t n_elements;
+  std::vector<gmsh_physical_info> physicals;
+  // heap needed to convert the file with the builtin reader
+  int64_t estimated_peak_bytes;
+};
+
 extern const std::map<gmsh_element_type, element_type> gmsh_type_to_elem_type;
 extern const std::map<gmsh_element_type, std::vector<int>>
     gmsh_type_node_order_map;
 extern const std::map<gmsh_element_type, int> gmsh_type_n_nodes;
 int n_nodes_from_type(gmsh_element_type type);
 IntermediateMesh read_gmsh_file(std::string filepath);
+// refills imesh, reusing its allocations when converting repeatedly
+void read_gmsh_file(const std::string &filepath, IntermediateMesh &imesh);
+IntermediateMesh read_gmsh_stream(std::istream &infile);
+IntermediateMesh read_gmsh_buffer(const char *data, size_t size);
+gmsh_file_info read_gmsh_info(const std::string &filepath);
 IntermediateMesh read_gmsh_sdk_file(std::string filepath);
+// reads the current model of an already initialized Gmsh session
+IntermediateMesh read_gmsh_model();
 } // namespace msh2exo
@@ -5,37 +5,102 @@
 // See the LICENSE file for license information.
 #include "config.hpp"
 #ifdef ENABLE_GMSH
+#include "dense_bitset.hpp"
 #include "gmsh_reader.hpp"
 #include "intermediate_mesh.hpp"
+#include "parallel.hpp"
+#include "progress.hpp"
+#include "tag_lookup.hpp"
 #include "util.hpp"
 #include <algorithm>
 #include <cmath>
 #include <fmt/format.h>
 #include <gmsh.h>
 #include <numeric>
-#include <set>
+
+// Numbers the tags of all blocks block after block, each block's in sorted
+// order, skipping the tags an earlier block numbered. Returns the number of
+// tags each block added.
+static std::vector<int64_t>
+number_tags(const std::vector<std::vector<size_t>> &block_tags,
+            std::vector<int64_t> &tags) {
+  std::vector<size_t> all_tags;
+  for (const auto &block : block_tags) {
+    all_tags.insert(all_tags.end(), block.begin(), block.end());
+  }
+  msh2exo::tag_lookup first(all_tags);
+  std::vector<int64_t> n_added(block_tags.size());
+  tags.clear();
+  int64_t index = 0;
+  for (size_t block = 0; block < block_tags.size(); block++) {
+    auto n_before = tags.size();
+    for (auto tag : block_tags[block]) {
+      if (first.find(tag) == index++) {
+        tags.push_back(tag);
+      }
+    }
+    n_added[block] = tags.size() - n_before;
+  }
+  return n_added;
+}
+
+// index of a gmsh tag used by physical group name, which must be in a block
+static int64_t block_tag_index(const msh2exo::tag_lookup &lookup, size_t tag,
+                               const char *kind, const std::string &name) {
+  auto index = lookup.find(static_cast<int64_t>(tag));
+  MSH2EXO_READ_CHECK(index >= 0,
+                     fmt::format("GMSH SDK READER: physical group {} has {} "
+                                 "{}, which is in no block",
+                                 name, kind, tag));
+  return index;
+}
+
+// sorted and without repeats
+static void sort_tags(std::vector<size_t> &tags) {
+  std::sort(tags.begin(), tags.end());
+  tags.erase(std::unique(tags.begin(), tags.end()), tags.end());
+}
 
 msh2exo::IntermediateMesh msh2exo::read_gmsh_sdk_file(std::string filepath) {
-  gmsh::initialize();
+  // the session is kept for later calls, initializing Gmsh dominates the
+  // time to convert small meshes
+  static bool initialized = false;
+  if (!initialized) {
+    gmsh::initialize();
+    initialized = true;
+  }
+  gmsh::clear();
+  progress_stage("reading (Gmsh)", 0, "B");
+
+  try {
+    gmsh::open(filepath);
+  } catch (std::exception &e) {
+    MSH2EXO_READ_CHECK(false, fmt::format("GMSH SDK READER: {}", e.what()));
+  }
+
+  return read_gmsh_model();
+}
 
-  gmsh::open(filepath);
+msh2exo::IntermediateMesh msh2exo::read_gmsh_model() {
+  std::string model_name;
+  gmsh::model::getCurrent(model_name);
 
   std::vector<std::size_t> node_tags;
   std::vector<double> coords;
   std::vector<double> parametric_coord;
   gmsh::model::mesh::getNodes(node_tags, coords, parametric_coord);
 
-  MSH2EXO_CHECK(node_tags.size() > 0,
-                fmt::format("GMSH SDK READER: No nodes for mesh file {}",
-                            filepath.c_str()));
+  MSH2EXO_READ_CHECK(
+      node_tags.size() > 0,
+      fmt::format("GMSH SDK READER: No nodes for model {}", model_name));
 
   gmsh::vectorpair dim_tags;
   gmsh::model::getPhysicalGroups(dim_tags);
 
-  MSH2EXO_CHECK(
+  MSH2EXO_READ_CHECK(
       dim_tags.size() > 0,
-      fmt::format("GMSH SDK READER: No physical groups for mesh file {}",
-                  filepath.c_str()));
+      fmt::format("GMSH SDK READER: No physical groups for model {}",
+                  model_name));
 
   std::vector<std::string> phys_names;
   for (auto pair : dim_tags) {
@@ -97,13 +162,13 @@ msh2exo::IntermediateMesh msh2exo::read_gmsh_sdk_file(std::string filepath) {
 
   imesh.n_blocks = n_blocks;
   imesh.blocks.resize(n_blocks);
-  std::vector<std::set<size_t>> node_set(n_blocks);
-  std::vector<std::set<size_t>> elem_set(n_blocks);
+  std::vector<std::vector<size_t>> node_set(n_blocks);
+  std::vector<std::vector<size_t>> elem_set(n_blocks);
   size_t block_index = 0;
   for (size_t i = 0; i < dim_tags.size(); i++) {
     if (dim_tags[i].first == max_dim) {
       // make sure elements are all of the same type
-      MSH2EXO_CHECK(
+      MSH2EXO_READ_CHECK(
           phys_elems[i][0].element_types.size() == 1,
           fmt::format(
               "GMSH SDK READER: More than 1 element type in physical {}",
@@ -111,50 +176,45 @@ msh2exo::IntermediateMesh msh2exo::read_gmsh_sdk_file(std::string filepath) {
       imesh.blocks[block_index].n_elements = std::accumulate(
           phys_elems[i].begin(), phys_elems[i].end(), 0ull,
           [](auto acc, auto val) { return acc + val.element_tags[0].size(); });
-      imesh.blocks[block_index].type = gmsh_type_to_elem_type.at(
+      auto type_it = gmsh_type_to_elem_type.find(
           static_cast<gmsh_element_type>(phys_elems[i][0].element_types[0]));
+      MSH2EXO_READ_CHECK(
+          type_it != gmsh_type_to_elem_type.end(),
+          fmt::format("GMSH SDK READER: unsupported element type {} in "
+                      "physical {}",
+                      phys_elems[i][0].element_types[0], phys_names[i]));
+      imesh.blocks[block_index].type = type_it->second;
       for (size_t j = 0; j < phys_elems[i].size(); j++) {
         for (size_t k = 0; k < phys_elems[i][j].element_tags.size(); k++) {
-          for (size_t m = 0; m < phys_elems[i][j].element_tags[k].size(); m++) {
-            elem_set[block_index].insert(phys_elems[i][j].element_tags[k][m]);
-          }
+          elem_set[block_index].insert(
+              elem_set[block_index].end(),
+              phys_elems[i][j].element_tags[k].begin(),
+              phys_elems[i][j].element_tags[k].end());
         }
       }
+      sort_tags(elem_set[block_index]);
       for (size_t j = 0; j < phys_elems[i].size(); j++) {
         for (size_t k = 0; k < phys_elems[i][j].elem_node_tags.size(); k++) {
-          for (size_t m = 0; m < phys_elems[i][j].elem_node_tags[k].size();
-               m++) {
-            node_set[block_index].insert(phys_elems[i][j].elem_node_tags[k][m]);
-          }
+          node_set[block_index].insert(
+              node_set[block_index].end(),
+              phys_elems[i][j].elem_node_tags[k].begin(),
+              phys_elems[i][j].elem_node_tags[k].end());
         }
       }
+      sort_tags(node_set[block_index]);
       block_index++;
     }
   }
 
-  std::map<size_t, int64_t> node_index_map;
-  int64_t node_index = 0;
-  for (int64_t block = 0; block < n_blocks; block++) {
-    for (auto nid : node_set[block]) {
-      if (node_index_map.find(nid) == node_index_map.end()) {
-        node_index_map.insert({nid, node_index++});
-      }
-    }
-  }
-  std::map<size_t, int64_t> elem_index_map;
-  int64_t elem_index = 0;
+  number_tags(node_set, imesh.node_tags);
+  auto n_block_elements = number_tags(elem_set, imesh.elem_tags);
   for (int64_t block = 0; block < n_blocks; block++) {
-    size_t start_elem_index = elem_index;
-    for (auto eid : elem_set[block]) {
-      if (elem_index_map.find(eid) == elem_index_map.end()) {
-        elem_index_map.insert({eid, elem_index++});
-      }
-    }
-    imesh.blocks[block].n_elements = elem_index - start_elem_index;
+    imesh.blocks[block].n_elements = n_block_elements[block];
   }
-
-  imesh.n_nodes = node_index;
-  imesh.n_elements = elem_index;
+  imesh.n_nodes = imesh.node_tags.size();
+  imesh.n_elements = imesh.elem_tags.size();
+  tag_lookup node_lookup(imesh.node_tags);
+  tag_lookup elem_lookup(imesh.elem_tags);
 
   // generate connectivity
   for (int64_t block = 0; block < n_blocks; block++) {
@@ -166,61 +226,86 @@ msh2exo::IntermediateMesh msh2exo::read_gmsh_sdk_file(std::string filepath) {
   block_index = 0;
   int64_t start_elem = 0;
   int64_t elem_count = 0;
+  std::vector<size_t> boundary_groups;
 
   for (size_t i = 0; i < dim_tags.size(); i++) {
     if (dim_tags[i].first == max_dim) {
       for (size_t j = 0; j < phys_elems[i].size(); j++) {
         for (size_t k = 0; k < phys_elems[i][j].element_tags.size(); k++) {
-          auto n_nodes_per_elem =
-              gmsh_type_n_nodes.at(static_cast<gmsh_element_type>(
-                  phys_elems[i][j].element_types[k]));
+          auto gmsh_type = static_cast<gmsh_element_type>(
+              phys_elems[i][j].element_types[k]);
+          auto n_nodes_per_elem = gmsh_type_n_nodes.at(gmsh_type);
+          std::vector<int> order(n_nodes_per_elem);
+          std::iota(order.begin(), order.end(), 0);
+          auto reorder = gmsh_type_node_order_map.find(gmsh_type);
+          if (reorder != gmsh_type_node_order_map.end()) {
+            order = reorder->second;
+          }
           for (size_t m = 0; m < phys_elems[i][j].element_tags[k].size(); m++) {
-            auto elem = elem_index_map.at(phys_elems[i][j].element_tags[k][m]);
+            auto elem = block_tag_index(elem_lookup,
+                                        phys_elems[i][j].element_tags[k][m],
+                                        "element", phys_names[i]);
             for (int n = 0; n < n_nodes_per_elem; n++) {
               imesh.blocks[block_index]
                   .connectivity[(elem - start_elem) * n_nodes_per_elem + n] =
-                  node_index_map.at(
+                  block_tag_index(
+                      node_lookup,
                       phys_elems[i][j]
-                          .elem_node_tags[k][m * n_nodes_per_elem + n]);
+                          .elem_node_tags[k][m * n_nodes_per_elem + order[n]],
+                      "node", phys_names[i]);
             }
             elem_count++;
           }
         }
       }
       imesh.blocks[block_index].name = phys_names[i];
-      start_elem = elem_count;
+      start_elem += elem_count;
       elem_count = 0;
       block_index++;
     } else {
-      auto tag = dim_tags[i].second;
-      auto name = phys_names[i];
-      std::set<int64_t> nodes;
+      boundary_groups.push_back(i);
+    }
+  }
+
+  imesh.boundaries.resize(boundary_groups.size());
+  std::vector<dense_bitset> thread_marks(thread_count());
+  auto build_boundaries = [&](int64_t begin, int64_t end, int thread) {
+    auto &marks = thread_marks[thread];
+    marks.resize(imesh.n_nodes);
+    for (int64_t b = begin; b < end; b++) {
+      auto i = boundary_groups[b];
       for (size_t j = 0; j < phys_elems[i].size(); j++) {
         for (size_t k = 0; k < phys_elems[i][j].elem_node_tags.size(); k++) {
           for (size_t n = 0; n < phys_elems[i][j].elem_node_tags[k].size();
                n++) {
-            nodes.insert(
-                node_index_map.at(phys_elems[i][j].elem_node_tags[k][n]));
+            marks.set(block_tag_index(node_lookup,
+                                      phys_elems[i][j].elem_node_tags[k][n],
+                                      "node", phys_names[i]));
           }
         }
       }
-      std::vector<int64_t> nodes_vector(nodes.begin(), nodes.end());
-      boundary bound{tag, name, std::move(nodes_vector)};
-      imesh.boundaries.push_back(std::move(bound));
+      auto &bound = imesh.boundaries[b];
+      bound.tag = dim_tags[i].second;
+      bound.name = phys_names[i];
+      marks.drain_sorted(bound.nodes);
     }
-  }
+  };
+  parallel_for_chunks(0, boundary_groups.size(), build_boundaries, 1);
 
-  std::vector<double> mapped_coords(coords.size());
+  // nodes outside the blocks are dropped
+  msh2exo::mesh_vector<double> mapped_coords(imesh.n_nodes * 3);
 
   for (size_t i = 0; i < node_tags.size(); i++) {
-    auto tag = node_tags[i];
-    auto new_index = node_index_map.at(tag);
+    auto index = node_lookup.find(node_tags[i]);
+    if (index < 0) {
+      continue;
+    }
     for (int j = 0; j < 3; j++) {
-      mapped_coords[new_index * 3 + j] = coords[i * 3 + j];
+      mapped_coords[index * 3 + j] = coords[i * 3 + j];
     }
   }
 
-  imesh.coords = mapped_coords;
+  imesh.coords.swap(mapped_coords);
 
   return imesh;
 }
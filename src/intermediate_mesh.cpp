@@ -23,5 +23,23 @@ const std::map<element_type, element_info> elem_info_map = {
        {0, 3, 4, 7},
        {0, 1, 2, 3},
        {4, 5, 6, 7}}}},
+    {element_type::tet10,
+     {10,
+      4,
+      {{0, 1, 3, 4, 8, 7},
+       {1, 2, 3, 5, 9, 8},
+       {0, 2, 3, 6, 9, 7},
+       {0, 1, 2, 4, 5, 6}}}},
+    {element_type::hex27,
+     {27,
+      6,
+      {{0, 1, 4, 5, 8, 13, 16, 12, 25},
+       {1, 2, 5, 6, 9, 14, 17, 13, 24},
+       {2, 3, 6, 7, 10, 15, 18, 14, 26},
+       {0, 3, 4, 7, 11, 15, 19, 12, 23},
+       {0, 1, 2, 3, 8, 9, 10, 11, 21},
+       {4, 5, 6, 7, 16, 17, 18, 19, 22}}}},
+    {element_type::wedge6,
+     {6, 5, {{0, 1, 3, 4}, {1, 2, 4, 5}, {0, 2, 3, 5}, {0, 1, 2}, {3, 4, 5}}}},
 };
 }
@@ -11,7 +11,10 @@
 #include <string>
 #include <vector>
 
+#include "mesh_allocator.hpp"
+
 namespace msh2exo {
+// stored by value in mesh snapshots, only append new types
 enum class element_type {
   line2,
   line3,
@@ -24,6 +27,7 @@ enum class element_type {
   hex27,
   tet4,
   tet10,
+  wedge6,
 };
 
 struct element_info {
@@ -36,6 +40,10 @@ struct boundary {
   int tag;
   std::string name;
   std::vector<int64_t> nodes;
+  // explicit sides (element index over all blocks, local side), written as
+  // given instead of searching elements for sides on the nodes
+  std::vector<int64_t> side_elems;
+  std::vector<int> side_ids;
 };
 
 extern const std::map<element_type, element_info> elem_info_map;
@@ -51,10 +59,14 @@ public:
     std::string name;
     int64_t n_elements;
     element_type type;
-    std::vector<int64_t> connectivity;
+    mesh_vector<int64_t> connectivity;
   };
-  std::vector<double> coords;
+  mesh_vector<double> coords;
   std::vector<block> blocks;
   std::vector<boundary> boundaries;
+  // gmsh tags of the nodes and of the elements in block order, used to map
+  // msh data sections onto the mesh, empty when unknown
+  std::vector<int64_t> node_tags;
+  std::vector<int64_t> elem_tags;
 };
 } // namespace msh2exo
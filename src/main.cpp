@@ -8,7 +8,7 @@
 #include "CLI/Formatter.hpp"
 #include "exodus_writer.hpp"
 #include "gmsh_reader.hpp"
-#include "options.hpp"
+#include "cli_options.hpp"
 #include "fmt/format.h"
 #include "util.hpp"
 
@@ -22,10 +22,16 @@ int main(int argc, char **argv) {
 
   CLI11_PARSE(app, argc, argv);
 
+  if (options.version) {
+    msh2exo::print_info();
+    return 0;
+  }
+
   try {
     msh2exo::run_msh2exo(options);
   } catch (std::exception &e) {
-    MSH2EXO_ERROR(fmt::format("{}\n", e.what()));
+    fmt::print(stderr, "{}\n", e.what());
+    return 1;
   }
 
   return 0;
@@ -0,0 +1,79 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "mesh_allocator.hpp"
+#include "parallel.hpp"
+
+// transparent huge page size on x86-64 and most aarch64 kernels
+static const size_t huge_page_size = 2 << 20;
+
+static void (*allocation_hook)(int64_t bytes) = nullptr;
+
+static size_t round_up(size_t bytes) {
+  return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+}
+
+void msh2exo::set_mesh_allocation_hook(void (*hook)(int64_t bytes)) {
+  allocation_hook = hook;
+}
+
+void *msh2exo::mesh_allocate(size_t bytes) {
+  if (bytes < huge_page_size) {
+    return ::operator new(bytes);
+  }
+  size_t size = round_up(bytes);
+#ifdef _WIN32
+  void *ptr = _aligned_malloc(size, huge_page_size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+#else
+  void *ptr = nullptr;
+  if (posix_memalign(&ptr, huge_page_size, size) != 0) {
+    throw std::bad_alloc();
+  }
+#ifdef MADV_HUGEPAGE
+  // only a hint, the pages stay small when THP is disabled
+  madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+#endif
+  if (allocation_hook != nullptr) {
+    allocation_hook(static_cast<int64_t>(size));
+  }
+  // the first write places a page on the NUMA node of the writing thread
+  char *base = static_cast<char *>(ptr);
+  parallel_for_chunks(
+      0, size,
+      [base](int64_t begin, int64_t end, int) {
+        std::memset(base + begin, 0, end - begin);
+      },
+      huge_page_size);
+  return ptr;
+}
+
+void msh2exo::mesh_deallocate(void *ptr, size_t bytes) {
+  if (bytes < huge_page_size) {
+    ::operator delete(ptr);
+    return;
+  }
+#ifdef _WIN32
+  _aligned_free(ptr);
+#else
+  std::free(ptr);
+#endif
+  if (allocation_hook != nullptr) {
+    allocation_hook(-static_cast<int64_t>(round_up(bytes)));
+  }
+}
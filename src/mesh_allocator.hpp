@@ -0,0 +1,67 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace msh2exo {
+// Storage for the large mesh arrays (coordinates, connectivity)
+//
+// Arrays of at least a huge page are aligned to it and advised to use
+// transparent huge pages, and their pages are first touched by the parallel
+// threads in the same contiguous chunks parallel_for_chunks hands out, so
+// on NUMA machines each thread's part of the array lives on its own node.
+// Smaller arrays come from operator new.
+void *mesh_allocate(size_t bytes);
+void mesh_deallocate(void *ptr, size_t bytes);
+
+// Called with the bytes of every huge page array allocated (positive) and
+// freed (negative), which bypass operator new; for heap accounting in
+// benchmarks. No hook by default.
+void set_mesh_allocation_hook(void (*hook)(int64_t bytes));
+
+// Allocator of mesh_vector. Elements added by resize() are default
+// initialized, i.e. left unset, so that the serial value initialization of
+// std::vector does not first touch the pages: every user writes them.
+template <typename T> class mesh_allocator {
+  static_assert(std::is_trivial<T>::value,
+                "mesh_allocator only holds trivial types");
+
+public:
+  using value_type = T;
+
+  mesh_allocator() = default;
+  template <typename U> mesh_allocator(const mesh_allocator<U> &) {}
+
+  T *allocate(size_t n) {
+    return static_cast<T *>(mesh_allocate(n * sizeof(T)));
+  }
+  void deallocate(T *ptr, size_t n) { mesh_deallocate(ptr, n * sizeof(T)); }
+
+  template <typename U> void construct(U *ptr) {
+    ::new (static_cast<void *>(ptr)) U;
+  }
+  template <typename U, typename... Args>
+  void construct(U *ptr, Args &&...args) {
+    ::new (static_cast<void *>(ptr)) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U> bool operator==(const mesh_allocator<U> &) const {
+    return true;
+  }
+  template <typename U> bool operator!=(const mesh_allocator<U> &) const {
+    return false;
+  }
+};
+
+template <typename T> using mesh_vector = std::vector<T, mesh_allocator<T>>;
+} // namespace msh2exo
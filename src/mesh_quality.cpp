@@ -0,0 +1,349 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <fmt/format.h>
+#include <limits>
+#include <map>
+
+#include "mesh_quality.hpp"
+#include "parallel.hpp"
+#include "progress.hpp"
+#include "util.hpp"
+
+struct shape {
+  int dim;
+  int n_corners;
+  // makes the scaled Jacobian of the ideal element 1
+  double scale;
+  // corner followed by its dim neighbours, ordered so the corner Jacobian
+  // of a valid element is positive
+  std::vector<std::array<int, 4>> corners;
+  std::vector<std::array<int, 2>> edges;
+};
+
+static const shape tri_shape = {2,
+                                3,
+                                2 / std::sqrt(3.0),
+                                {{0, 1, 2, 0}, {1, 2, 0, 0}, {2, 0, 1, 0}},
+                                {{0, 1}, {1, 2}, {2, 0}}};
+
+static const shape quad_shape = {
+    2,
+    4,
+    1,
+    {{0, 1, 3, 0}, {1, 2, 0, 0}, {2, 3, 1, 0}, {3, 0, 2, 0}},
+    {{0, 1}, {1, 2}, {2, 3}, {3, 0}}};
+
+static const shape tet_shape = {
+    3,
+    4,
+    std::sqrt(2.0),
+    {{0, 1, 2, 3}, {1, 2, 0, 3}, {2, 0, 1, 3}, {3, 0, 2, 1}},
+    {{0, 1}, {1, 2}, {2, 0}, {0, 3}, {1, 3}, {2, 3}}};
+
+static const shape hex_shape = {3,
+                                8,
+                                1,
+                                {{0, 1, 3, 4},
+                                 {1, 2, 0, 5},
+                                 {2, 3, 1, 6},
+                                 {3, 0, 2, 7},
+                                 {4, 7, 5, 0},
+                                 {5, 4, 6, 1},
+                                 {6, 5, 7, 2},
+                                 {7, 6, 4, 3}},
+                                {{0, 1},
+                                 {1, 2},
+                                 {2, 3},
+                                 {3, 0},
+                                 {4, 5},
+                                 {5, 6},
+                                 {6, 7},
+                                 {7, 4},
+                                 {0, 4},
+                                 {1, 5},
+                                 {2, 6},
+                                 {3, 7}}};
+
+static const std::map<msh2exo::element_type, const shape *> element_shape = {
+    {msh2exo::element_type::tri3, &tri_shape},
+    {msh2exo::element_type::tri6, &tri_shape},
+    {msh2exo::element_type::quad4, &quad_shape},
+    {msh2exo::element_type::quad8, &quad_shape},
+    {msh2exo::element_type::quad9, &quad_shape},
+    {msh2exo::element_type::tet4, &tet_shape},
+    {msh2exo::element_type::tet10, &tet_shape},
+    {msh2exo::element_type::hex8, &hex_shape},
+    {msh2exo::element_type::hex27, &hex_shape},
+};
+
+// connectivity permutations that invert an element
+static const std::map<msh2exo::element_type, std::vector<int>>
+    reorient_order = {
+        {msh2exo::element_type::tri3, {0, 2, 1}},
+        {msh2exo::element_type::tri6, {0, 2, 1, 5, 4, 3}},
+        {msh2exo::element_type::tet4, {0, 2, 1, 3}},
+        {msh2exo::element_type::tet10, {0, 2, 1, 3, 6, 5, 4, 7, 9, 8}},
+};
+
+static const double degenerate_jacobian = 1e-12;
+static const size_t max_reported = 10;
+
+// Elements are evaluated in batches with the corner coordinates gathered
+// into lane arrays, the metric loops run over the lanes without branches
+// so the compiler can vectorize them.
+static const int batch_size = 64;
+
+struct batch {
+  double x[8][batch_size];
+  double y[8][batch_size];
+  double z[8][batch_size];
+  double jacobian[batch_size];
+  // scaled Jacobian of the element turned inside out
+  double inverted_jacobian[batch_size];
+  double aspect_ratio[batch_size];
+};
+
+static void evaluate_batch(const shape &s, const double *coords,
+                           const int64_t *conn, int n_nodes_per_elem,
+                           int count, batch &b) {
+  for (int c = 0; c < s.n_corners; c++) {
+    for (int l = 0; l < count; l++) {
+      int64_t node = conn[l * n_nodes_per_elem + c];
+      b.x[c][l] = coords[node * 3];
+      b.y[c][l] = coords[node * 3 + 1];
+      b.z[c][l] = coords[node * 3 + 2];
+    }
+  }
+
+  for (int l = 0; l < count; l++) {
+    b.jacobian[l] = std::numeric_limits<double>::max();
+    b.inverted_jacobian[l] = std::numeric_limits<double>::max();
+  }
+  for (const auto &corner : s.corners) {
+    const int k = corner[0];
+    const int p = corner[1];
+    const int q = corner[2];
+    const int r = corner[3];
+    if (s.dim == 2) {
+      for (int l = 0; l < count; l++) {
+        double ax = b.x[p][l] - b.x[k][l];
+        double ay = b.y[p][l] - b.y[k][l];
+        double bx = b.x[q][l] - b.x[k][l];
+        double by = b.y[q][l] - b.y[k][l];
+        double det = ax * by - ay * bx;
+        double lengths = std::sqrt((ax * ax + ay * ay) * (bx * bx + by * by));
+        double scaled = lengths > 0 ? det / lengths : 0.0;
+        b.jacobian[l] = std::min(b.jacobian[l], scaled);
+        b.inverted_jacobian[l] = std::min(b.inverted_jacobian[l], -scaled);
+      }
+    } else {
+      for (int l = 0; l < count; l++) {
+        double ax = b.x[p][l] - b.x[k][l];
+        double ay = b.y[p][l] - b.y[k][l];
+        double az = b.z[p][l] - b.z[k][l];
+        double bx = b.x[q][l] - b.x[k][l];
+        double by = b.y[q][l] - b.y[k][l];
+        double bz = b.z[q][l] - b.z[k][l];
+        double cx = b.x[r][l] - b.x[k][l];
+        double cy = b.y[r][l] - b.y[k][l];
+        double cz = b.z[r][l] - b.z[k][l];
+        double det = ax * (by * cz - bz * cy) - ay * (bx * cz - bz * cx) +
+                     az * (bx * cy - by * cx);
+        double lengths =
+            std::sqrt((ax * ax + ay * ay + az * az) *
+                      (bx * bx + by * by + bz * bz) *
+                      (cx * cx + cy * cy + cz * cz));
+        double scaled = lengths > 0 ? det / lengths : 0.0;
+        b.jacobian[l] = std::min(b.jacobian[l], scaled);
+        b.inverted_jacobian[l] = std::min(b.inverted_jacobian[l], -scaled);
+      }
+    }
+  }
+  for (int l = 0; l < count; l++) {
+    b.jacobian[l] *= s.scale;
+    b.inverted_jacobian[l] *= s.scale;
+  }
+
+  double min_length[batch_size];
+  double max_length[batch_size];
+  for (int l = 0; l < count; l++) {
+    min_length[l] = std::numeric_limits<double>::max();
+    max_length[l] = 0;
+  }
+  for (const auto &edge : s.edges) {
+    for (int l = 0; l < count; l++) {
+      double dx = b.x[edge[1]][l] - b.x[edge[0]][l];
+      double dy = b.y[edge[1]][l] - b.y[edge[0]][l];
+      double dz = b.z[edge[1]][l] - b.z[edge[0]][l];
+      double length2 = dx * dx + dy * dy + dz * dz;
+      min_length[l] = std::min(min_length[l], length2);
+      max_length[l] = std::max(max_length[l], length2);
+    }
+  }
+  for (int l = 0; l < count; l++) {
+    b.aspect_ratio[l] = min_length[l] > 0
+                            ? std::sqrt(max_length[l] / min_length[l])
+                            : std::numeric_limits<double>::infinity();
+  }
+}
+
+static void accumulate(msh2exo::block_quality &total,
+                       const msh2exo::block_quality &part) {
+  total.min_jacobian = std::min(total.min_jacobian, part.min_jacobian);
+  total.max_jacobian = std::max(total.max_jacobian, part.max_jacobian);
+  total.min_aspect_ratio =
+      std::min(total.min_aspect_ratio, part.min_aspect_ratio);
+  total.max_aspect_ratio =
+      std::max(total.max_aspect_ratio, part.max_aspect_ratio);
+  total.n_inverted += part.n_inverted;
+  total.n_degenerate += part.n_degenerate;
+  total.n_reoriented += part.n_reoriented;
+  for (size_t k = 0; k < total.histogram.size(); k++) {
+    total.histogram[k] += part.histogram[k];
+  }
+  total.invalid_elements.insert(total.invalid_elements.end(),
+                                part.invalid_elements.begin(),
+                                part.invalid_elements.end());
+}
+
+static msh2exo::block_quality
+check_block(msh2exo::IntermediateMesh::block &block, const double *coords,
+            bool fix_orientation) {
+  msh2exo::block_quality result;
+  result.name = block.name;
+  result.type = block.type;
+  result.n_elements = block.n_elements;
+  result.min_jacobian = std::numeric_limits<double>::max();
+  result.max_jacobian = std::numeric_limits<double>::lowest();
+  result.min_aspect_ratio = std::numeric_limits<double>::max();
+  result.max_aspect_ratio = 0;
+
+  const shape &s = *element_shape.at(block.type);
+  const int n_nodes_per_elem = msh2exo::elem_info_map.at(block.type).n_nodes;
+  auto reorient = reorient_order.find(block.type);
+  const bool can_reorient =
+      fix_orientation && reorient != reorient_order.end();
+
+  std::vector<msh2exo::block_quality> parts(msh2exo::thread_count(), result);
+  msh2exo::parallel_for_chunks(
+      0, block.n_elements, [&](int64_t begin, int64_t end, int thread) {
+        auto &part = parts[thread];
+        batch b;
+        std::vector<int64_t> permuted(n_nodes_per_elem);
+        for (int64_t first = begin; first < end; first += batch_size) {
+          int count =
+              static_cast<int>(std::min<int64_t>(batch_size, end - first));
+          int64_t *conn = block.connectivity.data() + first * n_nodes_per_elem;
+          evaluate_batch(s, coords, conn, n_nodes_per_elem, count, b);
+          for (int l = 0; l < count; l++) {
+            double jacobian = b.jacobian[l];
+            // simplices have a constant Jacobian, an inverted one is valid
+            // once turned inside out
+            if (can_reorient && jacobian < -degenerate_jacobian) {
+              int64_t *elem = conn + l * n_nodes_per_elem;
+              for (int k = 0; k < n_nodes_per_elem; k++) {
+                permuted[k] = elem[reorient->second[k]];
+              }
+              std::copy(permuted.begin(), permuted.end(), elem);
+              jacobian = b.inverted_jacobian[l];
+              part.n_reoriented++;
+            }
+            part.min_jacobian = std::min(part.min_jacobian, jacobian);
+            part.max_jacobian = std::max(part.max_jacobian, jacobian);
+            part.min_aspect_ratio =
+                std::min(part.min_aspect_ratio, b.aspect_ratio[l]);
+            part.max_aspect_ratio =
+                std::max(part.max_aspect_ratio, b.aspect_ratio[l]);
+            int bin = jacobian < 0
+                          ? 0
+                          : 1 + std::min(9, static_cast<int>(jacobian * 10));
+            part.histogram[bin]++;
+            bool inverted = jacobian < -degenerate_jacobian;
+            bool degenerate = !inverted && jacobian <= degenerate_jacobian;
+            part.n_inverted += inverted;
+            part.n_degenerate += degenerate;
+            if ((inverted || degenerate) &&
+                part.invalid_elements.size() < max_reported) {
+              part.invalid_elements.push_back(first + l);
+            }
+          }
+        }
+      });
+
+  for (const auto &part : parts) {
+    accumulate(result, part);
+  }
+  std::sort(result.invalid_elements.begin(), result.invalid_elements.end());
+  if (result.invalid_elements.size() > max_reported) {
+    result.invalid_elements.resize(max_reported);
+  }
+  if (result.n_elements == 0) {
+    result.min_jacobian = result.max_jacobian = 0;
+    result.min_aspect_ratio = result.max_aspect_ratio = 0;
+  }
+  return result;
+}
+
+int64_t msh2exo::quality_report::n_invalid() const {
+  int64_t n = 0;
+  for (const auto &block : blocks) {
+    n += block.n_inverted + block.n_degenerate;
+  }
+  return n;
+}
+
+msh2exo::quality_report
+msh2exo::check_mesh_quality(IntermediateMesh &imesh, bool fix_orientation) {
+  quality_report report;
+  progress_stage("checking quality", imesh.n_elements, "elements");
+  for (auto &block : imesh.blocks) {
+    MSH2EXO_CHECK(element_shape.find(block.type) != element_shape.end(),
+                  fmt::format("mesh check: unsupported element type in "
+                              "block {}",
+                              block.name));
+    report.blocks.push_back(
+        check_block(block, imesh.coords.data(), fix_orientation));
+    progress_add(progress.done, block.n_elements);
+  }
+  return report;
+}
+
+void msh2exo::print_quality_report(const quality_report &report) {
+  int64_t elem_offset = 0;
+  for (const auto &block : report.blocks) {
+    fmt::print("BLOCK {}: {} elements\n", block.name, block.n_elements);
+    fmt::print("\t scaled jacobian: min {:.4g}, max {:.4g}\n",
+               block.min_jacobian, block.max_jacobian);
+    fmt::print("\t aspect ratio:    min {:.4g}, max {:.4g}\n",
+               block.min_aspect_ratio, block.max_aspect_ratio);
+    fmt::print("\t inverted {}, degenerate {}, reoriented {}\n",
+               block.n_inverted, block.n_degenerate, block.n_reoriented);
+    fmt::print("\t {:>12} {:>12}\n", "jacobian", "elements");
+    fmt::print("\t {:>12} {:>12}\n", "< 0", block.histogram[0]);
+    for (int k = 0; k < 10; k++) {
+      fmt::print("\t {:>12} {:>12}\n",
+                 fmt::format("[{:.1f}, {:.1f}{}", k / 10.0, (k + 1) / 10.0,
+                             k == 9 ? "]" : ")"),
+                 block.histogram[1 + k]);
+    }
+    if (!block.invalid_elements.empty()) {
+      std::string ids;
+      for (auto elem : block.invalid_elements) {
+        ids += fmt::format(" {}", elem_offset + elem + 1);
+      }
+      fmt::print("\t invalid elements:{}{}\n", ids,
+                 block.n_inverted + block.n_degenerate >
+                         static_cast<int64_t>(block.invalid_elements.size())
+                     ? " ..."
+                     : "");
+    }
+    elem_offset += block.n_elements;
+  }
+}
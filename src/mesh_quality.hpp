@@ -0,0 +1,52 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "intermediate_mesh.hpp"
+
+namespace msh2exo {
+struct block_quality {
+  std::string name;
+  element_type type;
+  int64_t n_elements = 0;
+  // scaled Jacobian: minimum over the element corners of the corner
+  // Jacobian determinant divided by its edge lengths, 1 for the ideal
+  // shape, <= 0 for inverted or degenerate elements
+  double min_jacobian = 0;
+  double max_jacobian = 0;
+  // longest over shortest edge
+  double min_aspect_ratio = 0;
+  double max_aspect_ratio = 0;
+  int64_t n_inverted = 0;
+  int64_t n_degenerate = 0;
+  int64_t n_reoriented = 0;
+  // scaled Jacobian counts: [0] below 0, [1 + k] in [k / 10, (k + 1) / 10)
+  std::array<int64_t, 11> histogram = {};
+  // first few inverted or degenerate elements, block local indices
+  std::vector<int64_t> invalid_elements;
+};
+
+struct quality_report {
+  std::vector<block_quality> blocks;
+  int64_t n_invalid() const;
+};
+
+// Computes scaled Jacobians, aspect ratios and orientation of every element
+// whose type is in elem_info_map, in parallel over each block. Higher order
+// elements are measured on their corner nodes. With fix_orientation,
+// inverted tri and tet elements are turned inside out by permuting their
+// connectivity and counted as valid.
+quality_report check_mesh_quality(IntermediateMesh &imesh,
+                                  bool fix_orientation);
+
+void print_quality_report(const quality_report &report);
+} // namespace msh2exo
@@ -0,0 +1,620 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <algorithm>
+#include <array>
+#include <fmt/format.h>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "dense_bitset.hpp"
+#include "mesh_refine.hpp"
+#include "parallel.hpp"
+#include "progress.hpp"
+#include "util.hpp"
+
+struct refine_rule {
+  // parent corners of each new node, the new nodes are numbered locally
+  // after the corners
+  std::vector<std::vector<int>> new_nodes;
+  // local nodes of the children, same element type as the parent
+  std::vector<std::vector<int>> children;
+  // (child, child side) pairs on each side of the parent
+  std::vector<std::vector<std::pair<int, int>>> side_children;
+  // new nodes on the sides of the parent (edges, and faces in 3D)
+  std::vector<int> boundary_new_nodes;
+};
+
+// Second order type of each linear type. The new nodes of its rule follow
+// the corners in the Exodus node order of that type, so the elevated
+// elements need no reordering.
+static const std::map<msh2exo::element_type, msh2exo::element_type>
+    second_order_type = {
+        {msh2exo::element_type::tri3, msh2exo::element_type::tri6},
+        {msh2exo::element_type::quad4, msh2exo::element_type::quad9},
+        {msh2exo::element_type::tet4, msh2exo::element_type::tet10},
+        {msh2exo::element_type::hex8, msh2exo::element_type::hex27},
+};
+
+// new nodes of up to four parents (edges, faces) can be shared with
+// neighbouring elements, hex centers never are
+static const size_t max_shared_parents = 4;
+static const int max_refined_nodes = 27;
+
+static const std::map<msh2exo::element_type, refine_rule> base_rules = {
+    {msh2exo::element_type::tri3,
+     {{{0, 1}, {1, 2}, {2, 0}},
+      {{0, 3, 5}, {3, 1, 4}, {5, 4, 2}, {3, 4, 5}},
+      {},
+      {}}},
+    {msh2exo::element_type::quad4,
+     {{{0, 1}, {1, 2}, {2, 3}, {3, 0}, {0, 1, 2, 3}},
+      {{0, 4, 8, 7}, {4, 1, 5, 8}, {8, 5, 2, 6}, {7, 8, 6, 3}},
+      {},
+      {}}},
+    {msh2exo::element_type::tet4,
+     {{{0, 1}, {1, 2}, {0, 2}, {0, 3}, {1, 3}, {2, 3}},
+      // four corner tets, the inner octahedron split around the 6-8
+      // diagonal
+      {{0, 4, 6, 7},
+       {4, 1, 5, 8},
+       {6, 5, 2, 9},
+       {7, 8, 9, 3},
+       {6, 8, 4, 5},
+       {6, 8, 5, 9},
+       {6, 8, 9, 7},
+       {6, 8, 7, 4}},
+      {},
+      {}}},
+    {msh2exo::element_type::hex8,
+     {{{0, 1},
+       {1, 2},
+       {2, 3},
+       {3, 0},
+       {0, 4},
+       {1, 5},
+       {2, 6},
+       {3, 7},
+       {4, 5},
+       {5, 6},
+       {6, 7},
+       {7, 4},
+       {0, 1, 2, 3, 4, 5, 6, 7},
+       {0, 1, 2, 3},
+       {4, 5, 6, 7},
+       {0, 3, 7, 4},
+       {1, 2, 6, 5},
+       {0, 1, 5, 4},
+       {2, 3, 7, 6}},
+      {{0, 8, 21, 11, 12, 25, 20, 23},
+       {8, 1, 9, 21, 25, 13, 24, 20},
+       {11, 21, 10, 3, 23, 20, 26, 15},
+       {21, 9, 2, 10, 20, 24, 14, 26},
+       {12, 25, 20, 23, 4, 16, 22, 19},
+       {25, 13, 24, 20, 16, 5, 17, 22},
+       {23, 20, 26, 15, 19, 22, 18, 7},
+       {20, 24, 14, 26, 22, 17, 6, 18}},
+      {},
+      {}}},
+};
+
+// A child side lies on a parent side when all its nodes do, i.e. they are
+// corners of the parent side or new nodes whose parents all are
+static std::map<msh2exo::element_type, refine_rule> make_rules() {
+  auto rules = base_rules;
+  for (auto &type_rule : rules) {
+    const auto &info = msh2exo::elem_info_map.at(type_rule.first);
+    auto &rule = type_rule.second;
+    for (const auto &side : info.local_side_order) {
+      std::vector<bool> on_side(info.n_nodes + rule.new_nodes.size());
+      for (auto ln : side) {
+        on_side[ln] = true;
+      }
+      for (size_t k = 0; k < rule.new_nodes.size(); k++) {
+        const auto &parents = rule.new_nodes[k];
+        on_side[info.n_nodes + k] =
+            std::all_of(parents.begin(), parents.end(),
+                        [&](int p) { return on_side[p]; });
+        if (on_side[info.n_nodes + k]) {
+          rule.boundary_new_nodes.push_back(static_cast<int>(k));
+        }
+      }
+      std::vector<std::pair<int, int>> covering;
+      for (size_t c = 0; c < rule.children.size(); c++) {
+        for (int cs = 0; cs < info.n_sides; cs++) {
+          const auto &child_side = info.local_side_order[cs];
+          if (std::all_of(child_side.begin(), child_side.end(), [&](int ln) {
+                return on_side[rule.children[c][ln]];
+              })) {
+            covering.emplace_back(static_cast<int>(c), cs);
+          }
+        }
+      }
+      rule.side_children.push_back(covering);
+    }
+    std::sort(rule.boundary_new_nodes.begin(), rule.boundary_new_nodes.end());
+    rule.boundary_new_nodes.erase(std::unique(rule.boundary_new_nodes.begin(),
+                                              rule.boundary_new_nodes.end()),
+                                  rule.boundary_new_nodes.end());
+  }
+  return rules;
+}
+
+// built on first use, elem_info_map may not be initialized before
+static const std::map<msh2exo::element_type, refine_rule> &refine_rules() {
+  static const auto rules = make_rules();
+  return rules;
+}
+
+struct shared_node {
+  // sorted parent nodes, unused entries -1
+  std::array<int64_t, max_shared_parents> key;
+  // first (block, element, new node) slot using the node
+  int64_t slot;
+};
+
+static uint64_t key_hash(const std::array<int64_t, max_shared_parents> &key) {
+  uint64_t h = 0x9E3779B97F4A7C15ULL;
+  for (auto node : key) {
+    h = (h ^ static_cast<uint64_t>(node)) * 0xC2B2AE3D27D4EB4FULL;
+    h ^= h >> 29;
+  }
+  return h;
+}
+
+static std::vector<const refine_rule *>
+find_rules(const msh2exo::IntermediateMesh &imesh, const char *what) {
+  std::vector<const refine_rule *> block_rule(imesh.n_blocks);
+  for (int64_t b = 0; b < imesh.n_blocks; b++) {
+    const auto &block = imesh.blocks[b];
+    auto rule = refine_rules().find(block.type);
+    MSH2EXO_CHECK(rule != refine_rules().end(),
+                  fmt::format("{}: unsupported element type in block {}",
+                              what, block.name));
+    block_rule[b] = &rule->second;
+  }
+  return block_rule;
+}
+
+struct added_nodes {
+  // first slot of each block, a slot per element and new node of its rule
+  std::vector<int64_t> block_slot_start;
+  // node of every slot
+  std::vector<int64_t> slot_node;
+  int64_t n_added;
+};
+
+// Adds the new nodes of the rules of every block after the existing nodes,
+// with coordinates, tags and the boundaries without explicit sides. The
+// block connectivity is left as is.
+static added_nodes
+add_new_nodes(msh2exo::IntermediateMesh &imesh,
+              const std::vector<const refine_rule *> &block_rule) {
+  // slots of shared nodes are resolved to the first slot with the same
+  // parents
+  added_nodes result;
+  auto &block_slot_start = result.block_slot_start;
+  auto &slot_node = result.slot_node;
+  int64_t n_slots = 0;
+  int64_t n_keys = 0;
+  block_slot_start.resize(imesh.n_blocks);
+  std::vector<int64_t> block_key_start(imesh.n_blocks);
+  std::vector<int> block_n_keyed(imesh.n_blocks);
+  for (int64_t b = 0; b < imesh.n_blocks; b++) {
+    const auto &new_parents = block_rule[b]->new_nodes;
+    block_slot_start[b] = n_slots;
+    block_key_start[b] = n_keys;
+    n_slots += imesh.blocks[b].n_elements * new_parents.size();
+    block_n_keyed[b] = static_cast<int>(
+        std::count_if(new_parents.begin(), new_parents.end(),
+                      [](const auto &parents) {
+                        return parents.size() <= max_shared_parents;
+                      }));
+    n_keys += imesh.blocks[b].n_elements * block_n_keyed[b];
+  }
+
+  std::vector<int64_t> owner(n_slots);
+  std::vector<shared_node> keys(n_keys);
+  for (int64_t b = 0; b < imesh.n_blocks; b++) {
+    const auto &block = imesh.blocks[b];
+    const auto &rule = *block_rule[b];
+    int n_corners = msh2exo::elem_info_map.at(block.type).n_nodes;
+    int n_new = static_cast<int>(rule.new_nodes.size());
+    msh2exo::parallel_for(0, block.n_elements, [&](int64_t j) {
+      int64_t next_key = block_key_start[b] + j * block_n_keyed[b];
+      for (int k = 0; k < n_new; k++) {
+        int64_t slot = block_slot_start[b] + j * n_new + k;
+        const auto &parents = rule.new_nodes[k];
+        owner[slot] = slot;
+        if (parents.size() > max_shared_parents) {
+          continue;
+        }
+        auto &key = keys[next_key++];
+        key.key.fill(-1);
+        for (size_t p = 0; p < parents.size(); p++) {
+          key.key[p] = block.connectivity[j * n_corners + parents[p]];
+        }
+        std::sort(key.key.begin(), key.key.begin() + parents.size());
+        key.slot = slot;
+      }
+    });
+  }
+
+  // partition by key hash so equal keys land in the same part
+  const int n_parts = msh2exo::thread_count() * 8;
+  std::vector<std::vector<int64_t>> part_count(msh2exo::thread_count(),
+                                               std::vector<int64_t>(n_parts));
+  auto count_parts = [&](int64_t begin, int64_t end, int thread) {
+    for (int64_t i = begin; i < end; i++) {
+      part_count[thread][key_hash(keys[i].key) % n_parts]++;
+    }
+  };
+  msh2exo::parallel_for_chunks(0, n_keys, count_parts);
+  std::vector<int64_t> part_start(n_parts + 1);
+  int64_t offset = 0;
+  for (int p = 0; p < n_parts; p++) {
+    part_start[p] = offset;
+    for (auto &counts : part_count) {
+      int64_t count = counts[p];
+      counts[p] = offset;
+      offset += count;
+    }
+  }
+  part_start[n_parts] = offset;
+
+  std::vector<shared_node> parted(n_keys);
+  auto scatter_parts = [&](int64_t begin, int64_t end, int thread) {
+    auto &cursor = part_count[thread];
+    for (int64_t i = begin; i < end; i++) {
+      parted[cursor[key_hash(keys[i].key) % n_parts]++] = keys[i];
+    }
+  };
+  msh2exo::parallel_for_chunks(0, n_keys, scatter_parts);
+  std::vector<shared_node>().swap(keys);
+
+  // Each part is deduplicated through its own open addressing table. The
+  // scatter keeps the keys of a part in slot order, so the first key seen
+  // is the first slot using the node and owns it.
+  auto hash_parts = [&](int64_t begin, int64_t end, int) {
+    std::vector<int64_t> table;
+    for (int64_t p = begin; p < end; p++) {
+      int64_t n_part = part_start[p + 1] - part_start[p];
+      size_t size = 16;
+      while (size < 2 * static_cast<size_t>(n_part)) {
+        size *= 2;
+      }
+      table.assign(size, -1);
+      for (int64_t i = part_start[p]; i < part_start[p + 1]; i++) {
+        const auto &key = parted[i];
+        // the low bits chose the part
+        size_t h = (key_hash(key.key) / n_parts) & (size - 1);
+        while (table[h] >= 0 && parted[table[h]].key != key.key) {
+          h = (h + 1) & (size - 1);
+        }
+        if (table[h] < 0) {
+          table[h] = i;
+        } else {
+          owner[key.slot] = parted[table[h]].slot;
+        }
+      }
+    }
+  };
+  msh2exo::parallel_for_chunks(0, n_parts, hash_parts, 1);
+  std::vector<shared_node>().swap(parted);
+
+  // owners are numbered in slot order, so the numbering does not depend on
+  // the thread count
+  slot_node.resize(n_slots);
+  std::vector<int64_t> thread_owners(msh2exo::thread_count() + 1);
+  auto count_owners = [&](int64_t begin, int64_t end, int thread) {
+    for (int64_t s = begin; s < end; s++) {
+      thread_owners[thread + 1] += owner[s] == s;
+    }
+  };
+  msh2exo::parallel_for_chunks(0, n_slots, count_owners);
+  for (int t = 0; t < msh2exo::thread_count(); t++) {
+    thread_owners[t + 1] += thread_owners[t];
+  }
+  int64_t n_old_nodes = imesh.n_nodes;
+  int64_t n_new_nodes = thread_owners[msh2exo::thread_count()];
+  auto number_owners = [&](int64_t begin, int64_t end, int thread) {
+    int64_t next = n_old_nodes + thread_owners[thread];
+    for (int64_t s = begin; s < end; s++) {
+      if (owner[s] == s) {
+        slot_node[s] = next++;
+      }
+    }
+  };
+  msh2exo::parallel_for_chunks(0, n_slots, number_owners);
+  msh2exo::parallel_for(0, n_slots, [&](int64_t s) {
+    if (owner[s] != s) {
+      slot_node[s] = slot_node[owner[s]];
+    }
+  });
+
+  // new nodes at the mean of their parents, which is the center of
+  // bilinear faces and trilinear hexes
+  imesh.coords.resize((n_old_nodes + n_new_nodes) * 3);
+  for (int64_t b = 0; b < imesh.n_blocks; b++) {
+    const auto &block = imesh.blocks[b];
+    const auto &rule = *block_rule[b];
+    int n_corners = msh2exo::elem_info_map.at(block.type).n_nodes;
+    int n_new = static_cast<int>(rule.new_nodes.size());
+    msh2exo::parallel_for(0, block.n_elements, [&](int64_t j) {
+      for (int k = 0; k < n_new; k++) {
+        int64_t slot = block_slot_start[b] + j * n_new + k;
+        if (owner[slot] != slot) {
+          continue;
+        }
+        int64_t node = slot_node[slot];
+        const auto &parents = rule.new_nodes[k];
+        for (int d = 0; d < 3; d++) {
+          double sum = 0;
+          for (auto p : parents) {
+            sum += imesh.coords[block.connectivity[j * n_corners + p] * 3 + d];
+          }
+          imesh.coords[node * 3 + d] = sum / parents.size();
+        }
+      }
+    });
+  }
+  std::vector<int64_t>().swap(owner);
+
+  if (!imesh.node_tags.empty()) {
+    int64_t next_tag =
+        *std::max_element(imesh.node_tags.begin(), imesh.node_tags.end()) + 1;
+    imesh.node_tags.resize(n_old_nodes + n_new_nodes);
+    for (int64_t i = n_old_nodes; i < n_old_nodes + n_new_nodes; i++) {
+      imesh.node_tags[i] = next_tag++;
+    }
+  }
+
+  // Boundaries without explicit sides gain the new nodes on element edges
+  // and faces whose corners they all hold, so curves in 3D meshes gain their
+  // edge midpoints too. Only the elements around a boundary's nodes are
+  // visited.
+  bool node_sets = std::any_of(
+      imesh.boundaries.begin(), imesh.boundaries.end(),
+      [](const auto &bound) { return bound.side_elems.empty(); });
+  std::vector<int64_t> block_elem_start(imesh.n_blocks + 1);
+  for (int64_t b = 0; b < imesh.n_blocks; b++) {
+    block_elem_start[b + 1] = block_elem_start[b] + imesh.blocks[b].n_elements;
+  }
+  // elements around each node, in compressed rows
+  std::vector<int64_t> node_elem_start;
+  std::vector<int64_t> node_elems;
+  if (node_sets) {
+    node_elem_start.assign(n_old_nodes + 1, 0);
+    for (const auto &block : imesh.blocks) {
+      for (auto node : block.connectivity) {
+        node_elem_start[node + 1]++;
+      }
+    }
+    for (int64_t i = 0; i < n_old_nodes; i++) {
+      node_elem_start[i + 1] += node_elem_start[i];
+    }
+    node_elems.resize(node_elem_start[n_old_nodes]);
+    std::vector<int64_t> fill(node_elem_start.begin(),
+                              node_elem_start.end() - 1);
+    for (int64_t b = 0; b < imesh.n_blocks; b++) {
+      const auto &block = imesh.blocks[b];
+      int n_corners = msh2exo::elem_info_map.at(block.type).n_nodes;
+      for (int64_t j = 0; j < block.n_elements; j++) {
+        for (int k = 0; k < n_corners; k++) {
+          auto node = block.connectivity[j * n_corners + k];
+          node_elems[fill[node]++] = block_elem_start[b] + j;
+        }
+      }
+    }
+  }
+
+  std::vector<msh2exo::dense_bitset> thread_marks(msh2exo::thread_count());
+  std::vector<msh2exo::dense_bitset> thread_elem_marks(
+      msh2exo::thread_count());
+  auto refine_node_sets = [&](int64_t begin, int64_t end, int thread) {
+    auto &marks = thread_marks[thread];
+    auto &elem_marks = thread_elem_marks[thread];
+    marks.resize(n_old_nodes + n_new_nodes);
+    elem_marks.resize(imesh.n_elements);
+    for (int64_t i = begin; i < end; i++) {
+      auto &bound = imesh.boundaries[i];
+      if (!bound.side_elems.empty()) {
+        continue;
+      }
+      for (auto node : bound.nodes) {
+        marks.set(node);
+        for (auto k = node_elem_start[node]; k < node_elem_start[node + 1];
+             k++) {
+          elem_marks.set(node_elems[k]);
+        }
+      }
+      elem_marks.drain([&](size_t index) {
+        auto elem = static_cast<int64_t>(index);
+        int64_t b = std::upper_bound(block_elem_start.begin(),
+                                     block_elem_start.end(), elem) -
+                    block_elem_start.begin() - 1;
+        const auto &block = imesh.blocks[b];
+        const auto &rule = *block_rule[b];
+        int n_corners = msh2exo::elem_info_map.at(block.type).n_nodes;
+        int n_new = static_cast<int>(rule.new_nodes.size());
+        int64_t j = elem - block_elem_start[b];
+        const int64_t *conn = block.connectivity.data() + j * n_corners;
+        for (auto k : rule.boundary_new_nodes) {
+          const auto &parents = rule.new_nodes[k];
+          if (std::all_of(parents.begin(), parents.end(),
+                          [&](int p) { return marks.test(conn[p]); })) {
+            marks.set(slot_node[block_slot_start[b] + j * n_new + k]);
+          }
+        }
+      });
+      bound.nodes.clear();
+      marks.drain_sorted(bound.nodes);
+    }
+  };
+  msh2exo::parallel_for_chunks(0, imesh.boundaries.size(), refine_node_sets,
+                               1);
+
+  imesh.n_nodes = n_old_nodes + n_new_nodes;
+  result.n_added = n_new_nodes;
+  return result;
+}
+
+// boundaries with explicit sides hold the nodes of their sides
+static void side_node_sets(msh2exo::IntermediateMesh &imesh,
+                           const std::vector<int64_t> &block_elem_start) {
+  std::vector<msh2exo::dense_bitset> thread_marks(msh2exo::thread_count());
+  auto collect = [&](int64_t begin, int64_t end, int thread) {
+    auto &marks = thread_marks[thread];
+    marks.resize(imesh.n_nodes);
+    for (int64_t i = begin; i < end; i++) {
+      auto &bound = imesh.boundaries[i];
+      if (bound.side_elems.empty()) {
+        continue;
+      }
+      for (size_t s = 0; s < bound.side_elems.size(); s++) {
+        int64_t elem = bound.side_elems[s];
+        int64_t b = std::upper_bound(block_elem_start.begin(),
+                                     block_elem_start.end(), elem) -
+                    block_elem_start.begin() - 1;
+        const auto &block = imesh.blocks[b];
+        const auto &info = msh2exo::elem_info_map.at(block.type);
+        const int64_t *conn = block.connectivity.data() +
+                              (elem - block_elem_start[b]) * info.n_nodes;
+        for (auto ln : info.local_side_order[bound.side_ids[s]]) {
+          marks.set(conn[ln]);
+        }
+      }
+      bound.nodes.clear();
+      marks.drain_sorted(bound.nodes);
+    }
+  };
+  msh2exo::parallel_for_chunks(0, imesh.boundaries.size(), collect, 1);
+}
+
+static int64_t refine_once(msh2exo::IntermediateMesh &imesh) {
+  auto block_rule = find_rules(imesh, "refine");
+  msh2exo::progress_stage("refining", imesh.n_elements, "elements");
+  auto added = add_new_nodes(imesh, block_rule);
+  const auto &block_slot_start = added.block_slot_start;
+  const auto &slot_node = added.slot_node;
+  imesh.elem_tags.clear();
+
+  std::vector<int64_t> block_elem_start(imesh.n_blocks + 1);
+  std::vector<int64_t> block_child_start(imesh.n_blocks + 1);
+  for (int64_t b = 0; b < imesh.n_blocks; b++) {
+    block_elem_start[b + 1] = block_elem_start[b] + imesh.blocks[b].n_elements;
+    block_child_start[b + 1] =
+        block_child_start[b] +
+        imesh.blocks[b].n_elements * block_rule[b]->children.size();
+  }
+
+  // explicit sides are replaced by the child sides covering them
+  auto refine_sides = [&](int64_t begin, int64_t end, int) {
+    for (int64_t i = begin; i < end; i++) {
+      auto &bound = imesh.boundaries[i];
+      std::vector<int64_t> side_elems;
+      std::vector<int> side_ids;
+      for (size_t s = 0; s < bound.side_elems.size(); s++) {
+        int64_t elem = bound.side_elems[s];
+        int64_t b = std::upper_bound(block_elem_start.begin(),
+                                     block_elem_start.end(), elem) -
+                    block_elem_start.begin() - 1;
+        const auto &rule = *block_rule[b];
+        int64_t first_child =
+            block_child_start[b] +
+            (elem - block_elem_start[b]) * rule.children.size();
+        for (const auto &child : rule.side_children[bound.side_ids[s]]) {
+          side_elems.push_back(first_child + child.first);
+          side_ids.push_back(child.second);
+        }
+      }
+      bound.side_elems.swap(side_elems);
+      bound.side_ids.swap(side_ids);
+    }
+  };
+  msh2exo::parallel_for_chunks(0, imesh.boundaries.size(), refine_sides, 1);
+
+  for (int64_t b = 0; b < imesh.n_blocks; b++) {
+    auto &block = imesh.blocks[b];
+    const auto &rule = *block_rule[b];
+    int n_corners = msh2exo::elem_info_map.at(block.type).n_nodes;
+    int n_new = static_cast<int>(rule.new_nodes.size());
+    int n_children = static_cast<int>(rule.children.size());
+    msh2exo::mesh_vector<int64_t> conn(block.n_elements * n_children *
+                                       n_corners);
+    auto split = [&](int64_t begin, int64_t end, int) {
+      std::array<int64_t, max_refined_nodes> refined;
+      for (int64_t j = begin; j < end; j++) {
+        for (int k = 0; k < n_corners; k++) {
+          refined[k] = block.connectivity[j * n_corners + k];
+        }
+        for (int k = 0; k < n_new; k++) {
+          refined[n_corners + k] =
+              slot_node[block_slot_start[b] + j * n_new + k];
+        }
+        int64_t *out = conn.data() + j * n_children * n_corners;
+        for (const auto &child : rule.children) {
+          for (auto ln : child) {
+            *out++ = refined[ln];
+          }
+        }
+      }
+      msh2exo::progress_add(msh2exo::progress.done, end - begin);
+    };
+    msh2exo::parallel_for_chunks(0, block.n_elements, split);
+    block.connectivity.swap(conn);
+    block.n_elements *= n_children;
+  }
+
+  imesh.n_elements = block_child_start[imesh.n_blocks];
+  side_node_sets(imesh, block_child_start);
+  return added.n_added;
+}
+
+int64_t msh2exo::refine_mesh(IntermediateMesh &imesh, int levels) {
+  int64_t n_added = 0;
+  for (int level = 0; level < levels; level++) {
+    n_added += refine_once(imesh);
+  }
+  return n_added;
+}
+
+int64_t msh2exo::elevate_order(IntermediateMesh &imesh) {
+  auto block_rule = find_rules(imesh, "order");
+  msh2exo::progress_stage("elevating order", imesh.n_elements, "elements");
+  auto added = add_new_nodes(imesh, block_rule);
+
+  std::vector<int64_t> block_elem_start(imesh.n_blocks + 1);
+  for (int64_t b = 0; b < imesh.n_blocks; b++) {
+    auto &block = imesh.blocks[b];
+    block_elem_start[b + 1] = block_elem_start[b] + block.n_elements;
+    int n_corners = elem_info_map.at(block.type).n_nodes;
+    int n_new = static_cast<int>(block_rule[b]->new_nodes.size());
+    int n_nodes = n_corners + n_new;
+    const int64_t *slot_node =
+        added.slot_node.data() + added.block_slot_start[b];
+    mesh_vector<int64_t> conn(block.n_elements * n_nodes);
+    auto elevate = [&](int64_t begin, int64_t end, int) {
+      for (int64_t j = begin; j < end; j++) {
+        int64_t *out = conn.data() + j * n_nodes;
+        for (int k = 0; k < n_corners; k++) {
+          out[k] = block.connectivity[j * n_corners + k];
+        }
+        for (int k = 0; k < n_new; k++) {
+          out[n_corners + k] = slot_node[j * n_new + k];
+        }
+      }
+      progress_add(progress.done, end - begin);
+    };
+    parallel_for_chunks(0, block.n_elements, elevate);
+    block.connectivity.swap(conn);
+    block.type = second_order_type.at(block.type);
+  }
+
+  side_node_sets(imesh, block_elem_start);
+  return added.n_added;
+}
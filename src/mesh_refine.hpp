@@ -0,0 +1,33 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <cstdint>
+
+#include "intermediate_mesh.hpp"
+
+namespace msh2exo {
+// Uniformly refines tri3, quad4, tet4 and hex8 blocks levels times, every
+// element is split into 4 (2D) or 8 (3D) children of its own type. New
+// nodes sit at edge midpoints, quad face centers and hex centers; the ones
+// shared between elements are found once by hashing the sorted parent
+// nodes, and numbered after the existing nodes in order of first use.
+// Explicit boundary sides are replaced by the child sides covering them;
+// boundaries given by nodes only gain the new nodes of the element edges
+// and faces they hold all corners of. Element tags are dropped. Returns the number of
+// nodes added.
+int64_t refine_mesh(IntermediateMesh &imesh, int levels);
+
+// Promotes tri3, quad4, tet4 and hex8 blocks to tri6, quad9, tet10 and
+// hex27. The mid-edge, face and center nodes are the new nodes refinement
+// would add, shared and numbered the same way, and appended to each
+// element's corners in Exodus order. Elements, their tags and their sides
+// are kept; boundaries given by nodes only gain the new edge and face nodes
+// whose corners they all hold, as in refine_mesh. Returns the number of
+// nodes added.
+int64_t elevate_order(IntermediateMesh &imesh);
+} // namespace msh2exo
@@ -0,0 +1,356 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <cstdio>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mesh_snapshot.hpp"
+#include "progress.hpp"
+#include "util.hpp"
+
+const uint32_t msh2exo::snapshot_version = 3;
+
+static const char snapshot_magic[8] = {'M', '2', 'E', 'X',
+                                       'S', 'N', 'A', 'P'};
+static const uint32_t snapshot_byte_order = 0x01020304;
+
+struct snapshot_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order;
+  int64_t dim;
+  int64_t n_nodes;
+  int64_t n_elements;
+  int64_t n_blocks;
+  int64_t n_boundaries;
+  int64_t total_size;
+};
+
+static size_t padded(size_t size) { return (size + 7) & ~size_t(7); }
+
+static void write_padded(std::ofstream &out, const void *data, size_t size) {
+  static const char zeros[8] = {};
+  out.write(static_cast<const char *>(data), size);
+  out.write(zeros, padded(size) - size);
+}
+
+static void write_value(std::ofstream &out, int64_t value) {
+  out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+void msh2exo::write_snapshot(const IntermediateMesh &imesh,
+                             const std::string &path) {
+  progress_stage("writing snapshot", 0, "");
+  // write to a temporary and rename so concurrent conversions sharing a
+  // cache directory never observe a partial snapshot
+  std::string tmp_path = path + ".tmp";
+  std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+  MSH2EXO_WRITE_CHECK(out.is_open(),
+                      fmt::format("could not create snapshot {}", tmp_path));
+
+  snapshot_header header;
+  std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+  header.version = snapshot_version;
+  header.byte_order = snapshot_byte_order;
+  header.dim = imesh.dim;
+  header.n_nodes = imesh.n_nodes;
+  header.n_elements = imesh.n_elements;
+  header.n_blocks = imesh.blocks.size();
+  header.n_boundaries = imesh.boundaries.size();
+  header.total_size = 0;
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+  write_padded(out, imesh.coords.data(), imesh.coords.size() * sizeof(double));
+  write_value(out, imesh.node_tags.size());
+  write_value(out, imesh.elem_tags.size());
+  write_padded(out, imesh.node_tags.data(),
+               imesh.node_tags.size() * sizeof(int64_t));
+  write_padded(out, imesh.elem_tags.data(),
+               imesh.elem_tags.size() * sizeof(int64_t));
+
+  for (const auto &block : imesh.blocks) {
+    write_value(out, static_cast<int64_t>(block.type));
+    write_value(out, block.n_elements);
+    write_value(out, block.name.size());
+    write_value(out, block.connectivity.size());
+    write_padded(out, block.name.data(), block.name.size());
+    write_padded(out, block.connectivity.data(),
+                 block.connectivity.size() * sizeof(int64_t));
+  }
+
+  for (const auto &bound : imesh.boundaries) {
+    write_value(out, bound.tag);
+    write_value(out, bound.name.size());
+    write_value(out, bound.nodes.size());
+    write_value(out, bound.side_elems.size());
+    write_padded(out, bound.name.data(), bound.name.size());
+    write_padded(out, bound.nodes.data(), bound.nodes.size() * sizeof(int64_t));
+    write_padded(out, bound.side_elems.data(),
+                 bound.side_elems.size() * sizeof(int64_t));
+    write_padded(out, bound.side_ids.data(),
+                 bound.side_ids.size() * sizeof(int));
+  }
+
+  // total size is filled in last, a snapshot cut short by a crash or a full
+  // disk is rejected when read
+  header.total_size = out.tellp();
+  out.seekp(0);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.close();
+  MSH2EXO_WRITE_CHECK(!out.fail(),
+                      fmt::format("could not write snapshot {}", tmp_path));
+
+#ifdef _WIN32
+  // rename does not replace existing files on Windows
+  std::remove(path.c_str());
+#endif
+  MSH2EXO_WRITE_CHECK(std::rename(tmp_path.c_str(), path.c_str()) == 0,
+                      fmt::format("could not rename snapshot to {}", path));
+}
+
+// read only view of a whole file, memory mapped where available
+class mapped_file {
+public:
+  explicit mapped_file(const std::string &path) {
+#ifndef _WIN32
+    int fd = ::open(path.c_str(), O_RDONLY);
+    MSH2EXO_READ_CHECK(fd >= 0,
+                       fmt::format("could not open snapshot {}", path));
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+      size_ = st.st_size;
+      void *map = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        ::madvise(map, size_, MADV_SEQUENTIAL);
+        ::madvise(map, size_, MADV_WILLNEED);
+        data_ = static_cast<const char *>(map);
+      }
+    }
+    ::close(fd);
+    MSH2EXO_READ_CHECK(data_ != nullptr,
+                       fmt::format("could not map snapshot {}", path));
+#else
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    MSH2EXO_READ_CHECK(in.is_open(),
+                       fmt::format("could not open snapshot {}", path));
+    size_ = in.tellg();
+    in.seekg(0);
+    buffer_.resize(size_);
+    in.read(buffer_.data(), size_);
+    data_ = buffer_.data();
+#endif
+  }
+
+  ~mapped_file() {
+#ifndef _WIN32
+    ::munmap(const_cast<char *>(data_), size_);
+#endif
+  }
+
+  mapped_file(const mapped_file &) = delete;
+  mapped_file &operator=(const mapped_file &) = delete;
+
+  const char *data() const { return data_; }
+  size_t size() const { return size_; }
+
+private:
+  const char *data_ = nullptr;
+  size_t size_ = 0;
+#ifdef _WIN32
+  std::vector<char> buffer_;
+#endif
+};
+
+// bounds checked sequential walk over the mapped snapshot
+class snapshot_cursor {
+public:
+  snapshot_cursor(const mapped_file &file, const std::string &path)
+      : file_(file), path_(path) {}
+
+  const char *take(size_t size) {
+    MSH2EXO_READ_CHECK(size <= file_.size() - offset_,
+                       fmt::format("snapshot {} is truncated", path_));
+    const char *ptr = file_.data() + offset_;
+    offset_ += padded(size);
+    if (offset_ > file_.size()) {
+      offset_ = file_.size();
+    }
+    return ptr;
+  }
+
+  int64_t value() {
+    int64_t val;
+    std::memcpy(&val, take(sizeof(val)), sizeof(val));
+    MSH2EXO_READ_CHECK(val >= 0, fmt::format("snapshot {} is corrupt", path_));
+    return val;
+  }
+
+  template <typename T, typename A>
+  void array(std::vector<T, A> &vec, int64_t count) {
+    MSH2EXO_READ_CHECK(static_cast<uint64_t>(count) <=
+                           (file_.size() - offset_) / sizeof(T),
+                       fmt::format("snapshot {} is truncated", path_));
+    vec.resize(count);
+    std::memcpy(vec.data(), take(count * sizeof(T)), count * sizeof(T));
+  }
+
+  // a count of records taking at least record_size bytes each, which must
+  // fit in the rest of the file
+  int64_t records(int64_t count, size_t record_size) {
+    MSH2EXO_READ_CHECK(count >= 0 && static_cast<uint64_t>(count) <=
+                                         (file_.size() - offset_) / record_size,
+                       fmt::format("snapshot {} is corrupt", path_));
+    return count;
+  }
+
+  std::string string(int64_t length) {
+    const char *ptr = take(length);
+    return std::string(ptr, length);
+  }
+
+private:
+  const mapped_file &file_;
+  const std::string &path_;
+  size_t offset_ = 0;
+};
+
+msh2exo::IntermediateMesh msh2exo::read_snapshot(const std::string &path) {
+  progress_stage("reading snapshot", 0, "");
+  mapped_file file(path);
+  snapshot_cursor cursor(file, path);
+
+  snapshot_header header;
+  std::memcpy(&header, cursor.take(sizeof(header)), sizeof(header));
+  MSH2EXO_READ_CHECK(
+      std::memcmp(header.magic, snapshot_magic, sizeof(header.magic)) == 0,
+      fmt::format("{} is not a msh2exo snapshot", path));
+  MSH2EXO_READ_CHECK(
+      header.version == snapshot_version &&
+          header.byte_order == snapshot_byte_order,
+      fmt::format("snapshot {} has version {}, expected {} in native byte "
+                  "order",
+                  path, header.version, snapshot_version));
+  MSH2EXO_READ_CHECK(static_cast<size_t>(header.total_size) == file.size(),
+                     fmt::format("snapshot {} is incomplete", path));
+
+  IntermediateMesh imesh;
+  imesh.dim = header.dim;
+  imesh.n_nodes = header.n_nodes;
+  imesh.n_elements = header.n_elements;
+  imesh.n_blocks = header.n_blocks;
+
+  cursor.array(imesh.coords, header.n_nodes * 3);
+  auto n_node_tags = cursor.value();
+  auto n_elem_tags = cursor.value();
+  cursor.array(imesh.node_tags, n_node_tags);
+  cursor.array(imesh.elem_tags, n_elem_tags);
+
+  // type, n_elements and the name and connectivity lengths
+  imesh.blocks.resize(cursor.records(header.n_blocks, 4 * sizeof(int64_t)));
+  for (auto &block : imesh.blocks) {
+    block.type = static_cast<element_type>(cursor.value());
+    block.n_elements = cursor.value();
+    auto name_length = cursor.value();
+    auto conn_length = cursor.value();
+    block.name = cursor.string(name_length);
+    cursor.array(block.connectivity, conn_length);
+  }
+
+  // tag and the name, node and side counts
+  imesh.boundaries.resize(
+      cursor.records(header.n_boundaries, 4 * sizeof(int64_t)));
+  for (auto &bound : imesh.boundaries) {
+    bound.tag = cursor.value();
+    auto name_length = cursor.value();
+    auto n_nodes = cursor.value();
+    auto n_sides = cursor.value();
+    bound.name = cursor.string(name_length);
+    cursor.array(bound.nodes, n_nodes);
+    cursor.array(bound.side_elems, n_sides);
+    cursor.array(bound.side_ids, n_sides);
+  }
+
+  return imesh;
+}
+
+bool msh2exo::is_snapshot_file(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  snapshot_header header;
+  if (!in.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+    return false;
+  }
+  return std::memcmp(header.magic, snapshot_magic, sizeof(header.magic)) == 0;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t prime3 = 0x165667B19E3779F9ULL;
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t input) {
+  acc += input * prime2;
+  return rotl64(acc, 31) * prime1;
+}
+
+uint64_t msh2exo::hash_file(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  MSH2EXO_READ_CHECK(in.is_open(), fmt::format("could not open {}", path));
+
+  // four independent lanes over 32 byte stripes, word at a time, so hashing
+  // runs at read bandwidth rather than byte by byte
+  uint64_t lanes[4] = {prime1 + prime2, prime2, 0, 0 - prime1};
+  uint64_t total = 0;
+  std::vector<char> buffer(1 << 20);
+  uint64_t tail = prime3;
+  while (in) {
+    in.read(buffer.data(), buffer.size());
+    size_t count = in.gcount();
+    total += count;
+    size_t stripes = count / 32;
+    for (size_t s = 0; s < stripes; s++) {
+      for (int l = 0; l < 4; l++) {
+        uint64_t word;
+        std::memcpy(&word, buffer.data() + s * 32 + l * 8, sizeof(word));
+        lanes[l] = hash_round(lanes[l], word);
+      }
+    }
+    for (size_t i = stripes * 32; i < count; i++) {
+      tail = (tail ^ static_cast<unsigned char>(buffer[i])) * prime1;
+    }
+  }
+
+  uint64_t hash = rotl64(lanes[0], 1) + rotl64(lanes[1], 7) +
+                  rotl64(lanes[2], 12) + rotl64(lanes[3], 18);
+  hash ^= hash_round(0, tail);
+  hash += total;
+  hash ^= hash >> 33;
+  hash *= prime2;
+  hash ^= hash >> 29;
+  hash *= prime3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+std::string msh2exo::snapshot_cache_path(const std::string &cache_dir,
+                                         const std::string &input_file,
+                                         bool builtin) {
+  // the readers number nodes differently, keep their snapshots apart
+  return fmt::format("{}/{:016x}-v{}-{}.m2es", cache_dir, hash_file(input_file),
+                     snapshot_version, builtin ? "builtin" : "sdk");
+}
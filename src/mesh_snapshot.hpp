@@ -0,0 +1,40 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "intermediate_mesh.hpp"
+
+namespace msh2exo {
+// Binary snapshots of an IntermediateMesh
+//
+// Layout (native byte order, every section 8 byte aligned):
+//   header   magic "M2EXSNAP", version, byte order mark, dim, n_nodes,
+//            n_elements, n_blocks, n_boundaries, total size
+//   coords   n_nodes * 3 doubles
+//   tags     node tag count, element tag count, int64 gmsh node tags,
+//            int64 gmsh element tags
+//   blocks   per block: type, n_elements, name length, connectivity length,
+//            name bytes, int64 connectivity
+//   bounds   per boundary: tag, name length, node count, side count,
+//            name bytes, int64 nodes, int64 side elements, int side ids
+//
+// Snapshots are read back through a memory map, the arrays are copied out
+// directly without any parsing.
+extern const uint32_t snapshot_version;
+
+void write_snapshot(const IntermediateMesh &imesh, const std::string &path);
+IntermediateMesh read_snapshot(const std::string &path);
+bool is_snapshot_file(const std::string &path);
+
+// content hash of a file, used as the snapshot cache key
+uint64_t hash_file(const std::string &path);
+std::string snapshot_cache_path(const std::string &cache_dir,
+                                const std::string &input_file, bool builtin);
+} // namespace msh2exo
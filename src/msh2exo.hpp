@@ -0,0 +1,25 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+// Public interface of libmsh2exo
+//
+// All failures are reported by throwing msh2exo::error (or the more specific
+// msh2exo::read_error / msh2exo::write_error), the library never exits the
+// calling process.
+
+#pragma once
+
+#include "exodus_writer.hpp"
+#include "face_sidesets.hpp"
+#include "field_data.hpp"
+#include "gmsh_reader.hpp"
+#include "intermediate_mesh.hpp"
+#include "mesh_quality.hpp"
+#include "mesh_refine.hpp"
+#include "mesh_snapshot.hpp"
+#include "node_merge.hpp"
+#include "options.hpp"
+#include "util.hpp"
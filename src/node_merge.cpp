@@ -0,0 +1,199 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <fmt/format.h>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "node_merge.hpp"
+#include "parallel.hpp"
+#include "progress.hpp"
+#include "util.hpp"
+
+static inline uint64_t cell_hash(int64_t ix, int64_t iy, int64_t iz,
+                                 uint64_t mask) {
+  uint64_t h = static_cast<uint64_t>(ix) * 0x9E3779B97F4A7C15ULL ^
+               static_cast<uint64_t>(iy) * 0xC2B2AE3D27D4EB4FULL ^
+               static_cast<uint64_t>(iz) * 0x165667B19E3779F9ULL;
+  h ^= h >> 32;
+  return h & mask;
+}
+
+int64_t msh2exo::merge_nodes(IntermediateMesh &imesh, double tolerance) {
+  MSH2EXO_CHECK(tolerance > 0,
+                fmt::format("merge tolerance must be positive, got {}",
+                            tolerance));
+  const int64_t n_nodes = imesh.n_nodes;
+  if (n_nodes == 0) {
+    return 0;
+  }
+  const double *coords = imesh.coords.data();
+
+  std::array<double, 3> lower;
+  std::array<double, 3> upper;
+  for (int d = 0; d < 3; d++) {
+    lower[d] = std::numeric_limits<double>::max();
+    upper[d] = std::numeric_limits<double>::lowest();
+  }
+  for (int64_t i = 0; i < n_nodes; i++) {
+    for (int d = 0; d < 3; d++) {
+      lower[d] = std::min(lower[d], coords[i * 3 + d]);
+      upper[d] = std::max(upper[d], coords[i * 3 + d]);
+    }
+  }
+  for (int d = 0; d < 3; d++) {
+    MSH2EXO_CHECK((upper[d] - lower[d]) / tolerance < 1e15,
+                  fmt::format("merge tolerance {} too small for mesh extent",
+                              tolerance));
+  }
+
+  // cells of edge tolerance, any two points within tolerance lie in the
+  // same or neighbouring cells
+  const double inv_cell = 1.0 / tolerance;
+  auto cell_of = [&](int64_t node, int d) {
+    return static_cast<int64_t>(
+        std::floor((coords[node * 3 + d] - lower[d]) * inv_cell));
+  };
+
+  uint64_t n_buckets = 1;
+  while (n_buckets < static_cast<uint64_t>(n_nodes)) {
+    n_buckets <<= 1;
+  }
+  const uint64_t mask = n_buckets - 1;
+
+  // counting sort of nodes by bucket: histogram, prefix sum, scatter
+  std::vector<uint64_t> node_bucket(n_nodes);
+  std::unique_ptr<std::atomic<int64_t>[]> bucket_fill(
+      new std::atomic<int64_t>[n_buckets]);
+  parallel_for(0, n_buckets,
+               [&](int64_t b) { bucket_fill[b].store(0); });
+  parallel_for(0, n_nodes, [&](int64_t i) {
+    node_bucket[i] = cell_hash(cell_of(i, 0), cell_of(i, 1), cell_of(i, 2),
+                               mask);
+    bucket_fill[node_bucket[i]].fetch_add(1, std::memory_order_relaxed);
+  });
+
+  std::vector<int64_t> bucket_start(n_buckets + 1);
+  bucket_start[0] = 0;
+  for (uint64_t b = 0; b < n_buckets; b++) {
+    bucket_start[b + 1] = bucket_start[b] + bucket_fill[b].load();
+    bucket_fill[b].store(bucket_start[b]);
+  }
+
+  std::vector<int64_t> bucket_nodes(n_nodes);
+  parallel_for(0, n_nodes, [&](int64_t i) {
+    auto slot =
+        bucket_fill[node_bucket[i]].fetch_add(1, std::memory_order_relaxed);
+    bucket_nodes[slot] = i;
+  });
+  bucket_fill.reset();
+  std::vector<uint64_t>().swap(node_bucket);
+
+  // lowest numbered node within tolerance of each node, independent of the
+  // order nodes landed in their buckets
+  const double tol2 = tolerance * tolerance;
+  std::vector<int64_t> target(n_nodes);
+  auto find_target = [&](int64_t i) {
+    int64_t best = i;
+    int64_t cx = cell_of(i, 0);
+    int64_t cy = cell_of(i, 1);
+    int64_t cz = cell_of(i, 2);
+    for (int64_t dx = -1; dx <= 1; dx++) {
+      for (int64_t dy = -1; dy <= 1; dy++) {
+        for (int64_t dz = -1; dz <= 1; dz++) {
+          auto b = cell_hash(cx + dx, cy + dy, cz + dz, mask);
+          for (int64_t k = bucket_start[b]; k < bucket_start[b + 1]; k++) {
+            int64_t j = bucket_nodes[k];
+            if (j >= best) {
+              continue;
+            }
+            double dist2 = 0;
+            for (int d = 0; d < 3; d++) {
+              double diff = coords[i * 3 + d] - coords[j * 3 + d];
+              dist2 += diff * diff;
+            }
+            if (dist2 <= tol2) {
+              best = j;
+            }
+          }
+        }
+      }
+    }
+    target[i] = best;
+  };
+  progress_stage("merging nodes", n_nodes, "nodes");
+  parallel_for_chunks(0, n_nodes, [&](int64_t begin, int64_t end, int) {
+    for (int64_t first = begin; first < end; first += progress_chunk) {
+      int64_t last = std::min(end, first + progress_chunk);
+      for (int64_t i = first; i < last; i++) {
+        find_target(i);
+      }
+      progress_add(progress.done, last - first);
+    }
+  });
+  std::vector<int64_t>().swap(bucket_nodes);
+  std::vector<int64_t>().swap(bucket_start);
+
+  // targets always point to lower numbered nodes, so one ascending pass
+  // resolves chains and assigns the new dense numbering
+  std::vector<int64_t> new_index(n_nodes);
+  int64_t n_kept = 0;
+  for (int64_t i = 0; i < n_nodes; i++) {
+    new_index[i] = target[i] == i ? n_kept++ : new_index[target[i]];
+  }
+  std::vector<int64_t>().swap(target);
+
+  int64_t n_removed = n_nodes - n_kept;
+  if (n_removed == 0) {
+    return 0;
+  }
+
+  // the lowest node of each merged group is the first to get its new index
+  mesh_vector<double> merged_coords(n_kept * 3);
+  for (int64_t i = 0, next = 0; i < n_nodes; i++) {
+    if (new_index[i] == next) {
+      for (int d = 0; d < 3; d++) {
+        merged_coords[next * 3 + d] = coords[i * 3 + d];
+      }
+      next++;
+    }
+  }
+  imesh.coords.swap(merged_coords);
+  imesh.n_nodes = n_kept;
+
+  // merged nodes keep the tag of their lowest numbered node
+  if (!imesh.node_tags.empty()) {
+    for (int64_t i = 0, next = 0; i < n_nodes; i++) {
+      if (new_index[i] == next) {
+        imesh.node_tags[next++] = imesh.node_tags[i];
+      }
+    }
+    imesh.node_tags.resize(n_kept);
+  }
+
+  for (auto &block : imesh.blocks) {
+    auto &conn = block.connectivity;
+    parallel_for(0, conn.size(),
+                 [&](int64_t k) { conn[k] = new_index[conn[k]]; });
+    progress_add(progress.elements_remapped, block.n_elements);
+  }
+
+  parallel_for(0, imesh.boundaries.size(), [&](int64_t b) {
+    auto &nodes = imesh.boundaries[b].nodes;
+    for (auto &node : nodes) {
+      node = new_index[node];
+    }
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+  });
+
+  return n_removed;
+}
@@ -0,0 +1,20 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <cstdint>
+
+#include "intermediate_mesh.hpp"
+
+namespace msh2exo {
+// Merges nodes closer than tolerance into the lowest numbered one, then
+// renumbers coords, block connectivity and boundary nodes. Coincident
+// points are found through a spatial hash of tolerance sized cells, so the
+// cost is linear in the number of nodes. Returns the number of nodes
+// removed.
+int64_t merge_nodes(IntermediateMesh &imesh, double tolerance);
+} // namespace msh2exo
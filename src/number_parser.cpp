@@ -0,0 +1,147 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <cstdlib>
+#include <string>
+
+#include "number_parser.hpp"
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 uint128;
+
+// 128 bit normalized powers of five for Eisel-Lemire, laid out as in
+// fast_float: 5^q truncated for q >= 0, floor(2^b / 5^-q) + 1 for q < 0.
+// Only the range needed by typical %.16g coordinates is tabulated, it is
+// small enough to compute exactly at startup; other exponents use strtod.
+struct power_of_five_table {
+  static const int min_q = -27;
+  static const int max_q = 55;
+  uint64_t high[max_q - min_q + 1];
+  uint64_t low[max_q - min_q + 1];
+
+  power_of_five_table() {
+    for (int q = min_q; q <= max_q; q++) {
+      uint128 c = 1;
+      if (q >= 0) {
+        for (int i = 0; i < q; i++) {
+          c *= 5;
+        }
+        while ((c >> 127) == 0) {
+          c <<= 1;
+        }
+      } else {
+        uint64_t power5 = 1;
+        for (int i = 0; i < -q; i++) {
+          power5 *= 5;
+        }
+        int z = 0;
+        while ((uint128(1) << z) < power5) {
+          z++;
+        }
+        // long division of 2^(z + 127) by power5, 64 bit limbs
+        int b = z + 127;
+        uint64_t numerator[3] = {0, 0, 0};
+        numerator[b / 64] = uint64_t(1) << (b % 64);
+        uint64_t quotient[3];
+        uint128 remainder = 0;
+        for (int k = 2; k >= 0; k--) {
+          uint128 current = (remainder << 64) | numerator[k];
+          quotient[k] = static_cast<uint64_t>(current / power5);
+          remainder = current % power5;
+        }
+        c = ((uint128(quotient[1]) << 64) | quotient[0]) + 1;
+      }
+      high[q - min_q] = static_cast<uint64_t>(c >> 64);
+      low[q - min_q] = static_cast<uint64_t>(c);
+    }
+  }
+};
+
+static const power_of_five_table power_of_five;
+
+bool msh2exo::detail::eisel_lemire(uint64_t w, int64_t q, double &value) {
+  if (w == 0 || q < power_of_five_table::min_q ||
+      q > power_of_five_table::max_q) {
+    return false;
+  }
+  int index = static_cast<int>(q) - power_of_five_table::min_q;
+  int lz = __builtin_clzll(w);
+  w <<= lz;
+
+  uint128 first = uint128(w) * power_of_five.high[index];
+  uint64_t high = static_cast<uint64_t>(first >> 64);
+  uint64_t low = static_cast<uint64_t>(first);
+  const uint64_t precision_mask = ~uint64_t(0) >> 55;
+  if ((high & precision_mask) == precision_mask) {
+    uint128 second = uint128(w) * power_of_five.low[index];
+    uint64_t second_high = static_cast<uint64_t>(second >> 64);
+    low += second_high;
+    if (second_high > low) {
+      high++;
+    }
+  }
+
+  int upperbit = static_cast<int>(high >> 63);
+  int shift = upperbit + 64 - 52 - 3;
+  uint64_t mantissa = high >> shift;
+  int32_t power2 = ((((152170 + 65536) * static_cast<int32_t>(q)) >> 16) +
+                    63) +
+                   upperbit - lz + 1023;
+  if (power2 <= 0) {
+    return false;
+  }
+
+  // exactly halfway between two doubles, round to even
+  if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 &&
+      (mantissa << shift) == high) {
+    mantissa &= ~uint64_t(1);
+  }
+  mantissa += mantissa & 1;
+  mantissa >>= 1;
+  if (mantissa >= (uint64_t(2) << 52)) {
+    mantissa = uint64_t(1) << 52;
+    power2++;
+  }
+  mantissa &= ~(uint64_t(1) << 52);
+  if (power2 >= 0x7FF) {
+    return false;
+  }
+
+  uint64_t bits = mantissa | (uint64_t(power2) << 52);
+  std::memcpy(&value, &bits, sizeof(value));
+  return true;
+}
+#else
+bool msh2exo::detail::eisel_lemire(uint64_t, int64_t, double &) {
+  return false;
+}
+#endif
+
+const char *msh2exo::detail::parse_double_slow(const char *p, const char *end,
+                                               double &value) {
+  // strtod needs a terminated string, copy the token out
+  const char *token_end = p;
+  while (token_end != end && static_cast<unsigned char>(*token_end) > ' ') {
+    token_end++;
+  }
+  char small[64];
+  std::string large;
+  const char *token = small;
+  size_t length = token_end - p;
+  if (length < sizeof(small)) {
+    std::memcpy(small, p, length);
+    small[length] = '\0';
+  } else {
+    large.assign(p, token_end);
+    token = large.c_str();
+  }
+  char *parse_end = nullptr;
+  value = std::strtod(token, &parse_end);
+  if (parse_end == token) {
+    return nullptr;
+  }
+  return p + (parse_end - token);
+}
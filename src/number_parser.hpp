@@ -0,0 +1,206 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+// Decimal number kernels for the builtin msh reader
+//
+// All functions work on [p, end) and return a pointer one past the parsed
+// text, or nullptr when no number could be parsed. Eight bytes are examined
+// at a time where possible (SWAR). Doubles take Clinger's exact fast path,
+// then Eisel-Lemire, and fall back to strtod for anything left, so results
+// are bit identical to operator>>.
+
+#pragma once
+
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#if (defined(__BYTE_ORDER__) &&                                                \
+     __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) ||                             \
+    defined(_WIN32)
+#define MSH2EXO_SWAR 1
+#endif
+
+namespace msh2exo {
+namespace detail {
+inline uint64_t load8(const char *p) {
+  uint64_t val;
+  std::memcpy(&val, p, sizeof(val));
+  return val;
+}
+
+inline int lowest_set_byte(uint64_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward64(&index, mask);
+  return static_cast<int>(index) / 8;
+#else
+  return __builtin_ctzll(mask) / 8;
+#endif
+}
+
+// high bit set in every byte that is > ' ' (or not ASCII)
+inline uint64_t non_space_mask(uint64_t x) {
+  return ((x + 0x5F5F5F5F5F5F5F5FULL) | x) & 0x8080808080808080ULL;
+}
+
+inline bool all_digits(uint64_t x) {
+  return (((x & 0xF0F0F0F0F0F0F0F0ULL) |
+           (((x + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ==
+          0x3333333333333333ULL);
+}
+
+inline uint32_t eight_digits(uint64_t x) {
+  const uint64_t mask = 0x000000FF000000FFULL;
+  const uint64_t mul1 = 0x000F424000000064ULL; // 100 + (1000000 << 32)
+  const uint64_t mul2 = 0x0000271000000001ULL; // 1 + (10000 << 32)
+  x -= 0x3030303030303030ULL;
+  x = (x * 10) + (x >> 8);
+  x = (((x & mask) * mul1) + (((x >> 16) & mask) * mul2)) >> 32;
+  return static_cast<uint32_t>(x);
+}
+
+inline bool is_digit(char c) { return static_cast<unsigned>(c - '0') < 10; }
+
+// consume a run of digits into mantissa, digits past the 19th are counted
+// but dropped, callers treat that as out of range
+inline const char *digit_run(const char *p, const char *end, uint64_t &mantissa,
+                             int &n_digits) {
+#ifdef MSH2EXO_SWAR
+  while (end - p >= 8 && n_digits <= 11 && all_digits(load8(p))) {
+    mantissa = mantissa * 100000000 + eight_digits(load8(p));
+    n_digits += 8;
+    p += 8;
+  }
+#endif
+  while (p != end && is_digit(*p)) {
+    if (n_digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+    }
+    n_digits++;
+    p++;
+  }
+  return p;
+}
+
+// correctly rounded w * 10^q, false when the exponent is outside the
+// tabulated range and the caller must fall back
+bool eisel_lemire(uint64_t w, int64_t q, double &value);
+const char *parse_double_slow(const char *p, const char *end, double &value);
+} // namespace detail
+
+inline const char *skip_whitespace(const char *p, const char *end) {
+#ifdef MSH2EXO_SWAR
+  while (end - p >= 8) {
+    uint64_t mask = detail::non_space_mask(detail::load8(p));
+    if (mask) {
+      return p + detail::lowest_set_byte(mask);
+    }
+    p += 8;
+  }
+#endif
+  while (p != end && static_cast<unsigned char>(*p) <= ' ') {
+    p++;
+  }
+  return p;
+}
+
+inline const char *parse_uint(const char *p, const char *end,
+                              uint64_t &value) {
+  if (p != end && *p == '+') {
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int n_digits = 0;
+  const char *start = p;
+  p = detail::digit_run(p, end, mantissa, n_digits);
+  // 19 digits always fit in 64 bits, anything longer is rejected
+  if (p == start || n_digits > 19) {
+    return nullptr;
+  }
+  value = mantissa;
+  return p;
+}
+
+inline const char *parse_int(const char *p, const char *end, int64_t &value) {
+  bool negative = p != end && *p == '-';
+  if (negative) {
+    p++;
+  }
+  uint64_t mantissa;
+  p = parse_uint(p, end, mantissa);
+  if (p == nullptr || mantissa > static_cast<uint64_t>(INT64_MAX)) {
+    return nullptr;
+  }
+  value = negative ? -static_cast<int64_t>(mantissa)
+                   : static_cast<int64_t>(mantissa);
+  return p;
+}
+
+inline const char *parse_double(const char *p, const char *end,
+                                double &value) {
+  static const double powers_of_ten[] = {
+      1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+  const char *start = p;
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+
+  uint64_t mantissa = 0;
+  int n_digits = 0;
+  const char *digits_start = p;
+  p = detail::digit_run(p, end, mantissa, n_digits);
+  int64_t exponent = 0;
+  if (p != end && *p == '.') {
+    p++;
+    const char *frac_start = p;
+    p = detail::digit_run(p, end, mantissa, n_digits);
+    exponent -= p - frac_start;
+  }
+  if (n_digits == 0 || p == digits_start) {
+    return detail::parse_double_slow(start, end, value);
+  }
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    int64_t exp_part;
+    const char *exp_end = parse_int(p + 1, end, exp_part);
+    if (exp_end == nullptr) {
+      return detail::parse_double_slow(start, end, value);
+    }
+    exponent += exp_part;
+    p = exp_end;
+  }
+
+  // Clinger's fast path: mantissa and power of ten are exact doubles, so a
+  // single multiply or divide gives the correctly rounded result
+#if FLT_EVAL_METHOD == 0
+  if (n_digits <= 19 && mantissa <= (uint64_t(1) << 53) && exponent >= -22 &&
+      exponent <= 22) {
+    double result = static_cast<double>(mantissa);
+    if (exponent < 0) {
+      result /= powers_of_ten[-exponent];
+    } else {
+      result *= powers_of_ten[exponent];
+    }
+    value = negative ? -result : result;
+    return p;
+  }
+#endif
+  double result;
+  if (n_digits <= 19 && detail::eisel_lemire(mantissa, exponent, result)) {
+    value = negative ? -result : result;
+    return p;
+  }
+  return detail::parse_double_slow(start, end, value);
+}
+} // namespace msh2exo
@@ -4,53 +4,346 @@
 //
 // See the LICENSE file for license information.
 
-#include "CLI/App.hpp"
-#include "CLI/Config.hpp"
-#include "CLI/Formatter.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <sys/stat.h>
+#include <thread>
 
+#include "arena.hpp"
+#include "compressed_input.hpp"
 #include "config.hpp"
 #include "exodus_writer.hpp"
+#include "face_sidesets.hpp"
+#include "field_data.hpp"
 #include "gmsh_reader.hpp"
+#include "mesh_quality.hpp"
+#include "mesh_refine.hpp"
+#include "mesh_snapshot.hpp"
+#include "node_merge.hpp"
 #include "options.hpp"
+#include "parallel.hpp"
+#include "progress.hpp"
 #include "util.hpp"
 
-void msh2exo::setup_options(CLI::App &app, msh2exo::Options &options) {
+static void run_stages(msh2exo::Options &options,
+                       msh2exo::IntermediateMesh &imesh,
+                       msh2exo::writer_buffers &buffers) {
+  bool builtin = true;
+  // pipes and standard input are read once, front to back
+  bool stream_input = msh2exo::is_stream_input(options.input_file);
+#ifdef ENABLE_GMSH
+  builtin = options.builtin;
+  // Gmsh can only open plain files, compressed and stream input is read
+  // through the builtin reader
+  if (!builtin && stream_input) {
+    msh2exo::print_if(options.verbose,
+                      "{}: stream input, using builtin reader\n",
+                      options.input_file);
+    builtin = true;
+  }
+  if (!builtin && msh2exo::detect_compression(options.input_file) !=
+                      msh2exo::compression::none) {
+    msh2exo::print_if(options.verbose,
+                      "{}: compressed input, using builtin reader\n",
+                      options.input_file);
+    builtin = true;
+  }
+#endif
 
-  app.add_flag_function(
-      "-V,--version", [](auto) { msh2exo::print_info_and_exit(); },
-      "print version and basic info");
+  MSH2EXO_CHECK(!(stream_input && !options.cache_dir.empty()),
+                fmt::format("{}: --cache-dir needs a file as input",
+                            options.input_file));
+  MSH2EXO_CHECK(!(stream_input && options.fields),
+                fmt::format("{}: --fields needs a file as input",
+                            options.input_file));
 
-  app.add_option("input_file", options.input_file, "Input (Gmsh msh) mesh file")
-      ->required()
-      ->check(CLI::ExistingFile);
+  std::string cache_file;
+  if (!options.cache_dir.empty()) {
+    cache_file = msh2exo::snapshot_cache_path(options.cache_dir,
+                                              options.input_file, builtin);
+  }
 
-  app.add_option("output_file", options.output_file,
-                 "Output (ExodusII) mesh file")
-      ->required();
-  app.add_flag("-b,--builtin", options.builtin, "Use builtin gmsh file reader");
+  bool snapshot_input =
+      !stream_input && msh2exo::is_snapshot_file(options.input_file);
+  MSH2EXO_CHECK(!(snapshot_input && options.fields),
+                fmt::format("{}: --fields needs the msh file as input",
+                            options.input_file));
+  MSH2EXO_CHECK(!(options.refine > 0 && options.fields),
+                fmt::format("{}: --fields can not be mapped onto a refined "
+                            "mesh",
+                            options.input_file));
+  MSH2EXO_CHECK(!(options.order > 1 && options.fields),
+                fmt::format("{}: --fields can not be mapped onto a second "
+                            "order mesh",
+                            options.input_file));
+  bool extrude = !options.extrude.empty();
+  int layers = extrude ? static_cast<int>(options.extrude[0]) : 0;
+  MSH2EXO_CHECK(!extrude || (options.extrude.size() == 2 && layers >= 1 &&
+                             layers == options.extrude[0] &&
+                             options.extrude[1] > 0),
+                fmt::format("{}: --extrude needs a positive number of layers "
+                            "and a positive height",
+                            options.input_file));
+  MSH2EXO_CHECK(!(extrude && options.fields),
+                fmt::format("{}: --fields can not be mapped onto an extruded "
+                            "mesh",
+                            options.input_file));
 
-  app.add_flag("-v,--verbose", options.verbose, "increase verbosity");
+  MSH2EXO_CHECK((options.scale.empty() || options.scale.size() == 1 ||
+                 options.scale.size() == 3) &&
+                    std::all_of(options.scale.begin(), options.scale.end(),
+                                [](double factor) { return factor > 0; }),
+                fmt::format("{}: --scale needs one or three positive factors",
+                            options.input_file));
+  MSH2EXO_CHECK(options.rotate.empty() || options.rotate.size() == 3,
+                fmt::format("{}: --rotate needs three angles",
+                            options.input_file));
+  MSH2EXO_CHECK(options.translate.empty() || options.translate.size() == 3,
+                fmt::format("{}: --translate needs three components",
+                            options.input_file));
 
-  // app.add_flag("-f,--force", options.force,
-  //               "Force, overwrite existing ExodusII file");
-}
+  if (snapshot_input) {
+    msh2exo::print_if(options.verbose, "{}: reading snapshot\n",
+                      options.input_file);
+    imesh = msh2exo::read_snapshot(options.input_file);
+  } else if (!cache_file.empty() && msh2exo::is_snapshot_file(cache_file)) {
+    msh2exo::print_if(options.verbose, "{}: reading cached snapshot {}\n",
+                      options.input_file, cache_file);
+    imesh = msh2exo::read_snapshot(cache_file);
+  } else {
+    auto rss_before = msh2exo::peak_rss_bytes();
+    auto arena_before = msh2exo::arena::counters();
+#ifdef ENABLE_GMSH
+    if (builtin) {
+      msh2exo::read_gmsh_file(options.input_file, imesh);
+    } else {
+      imesh = msh2exo::read_gmsh_sdk_file(options.input_file);
+    }
+#else
+    msh2exo::read_gmsh_file(options.input_file, imesh);
+#endif
+    auto arena_after = msh2exo::arena::counters();
+    msh2exo::print_if(
+        options.verbose,
+        "{}: peak RSS {:.1f} MiB before reading, {:.1f} MiB after, reader "
+        "arenas {} allocations in {} blocks ({:.1f} MiB)\n",
+        options.input_file, rss_before / 1048576.0,
+        msh2exo::peak_rss_bytes() / 1048576.0,
+        arena_after.n_allocations - arena_before.n_allocations,
+        arena_after.n_blocks - arena_before.n_blocks,
+        (arena_after.bytes - arena_before.bytes) / 1048576.0);
+    if (!cache_file.empty()) {
+      msh2exo::print_if(options.verbose, "{}: caching snapshot {}\n",
+                        options.input_file, cache_file);
+      msh2exo::write_snapshot(imesh, cache_file);
+    }
+  }
 
-void msh2exo::run_msh2exo(msh2exo::Options &options) {
+  if (options.merge_tolerance > 0) {
+    auto n_merged = msh2exo::merge_nodes(imesh, options.merge_tolerance);
+    msh2exo::print_if(options.verbose, "merged {} duplicate nodes\n",
+                      n_merged);
+  }
 
-  if (options.version) {
-    msh2exo::print_info_and_exit();
+  if (options.refine > 0) {
+    auto n_added = msh2exo::refine_mesh(imesh, options.refine);
+    msh2exo::print_if(options.verbose,
+                      "refined {} times: {} nodes added, {} elements\n",
+                      options.refine, n_added, imesh.n_elements);
   }
 
-  IntermediateMesh imesh;
+  if (options.order > 1) {
+    auto n_added = msh2exo::elevate_order(imesh);
+    msh2exo::print_if(options.verbose,
+                      "elevated to second order: {} nodes added\n", n_added);
+  }
 
-#ifdef ENABLE_GMSH
-  if (options.builtin) {
-    imesh = msh2exo::read_gmsh_file(options.input_file);
+  if (options.check || options.fix_orientation) {
+    auto report =
+        msh2exo::check_mesh_quality(imesh, options.fix_orientation);
+    msh2exo::print_quality_report(report);
+    MSH2EXO_CHECK(report.n_invalid() == 0,
+                  fmt::format("{}: {} inverted or degenerate elements",
+                              options.input_file, report.n_invalid()));
+  }
+
+  if (options.skin || options.interfaces) {
+    auto n_added =
+        msh2exo::add_face_sidesets(imesh, options.skin, options.interfaces);
+    msh2exo::print_if(options.verbose, "added {} generated sidesets\n",
+                      n_added);
+  }
+
+  if (!options.snapshot_file.empty()) {
+    msh2exo::write_snapshot(imesh, options.snapshot_file);
+  }
+
+  if (extrude) {
+    msh2exo::write_extruded_mesh(imesh, layers, options.extrude[1],
+                                 options.output_file, options, buffers);
   } else {
-    imesh = msh2exo::read_gmsh_sdk_file(options.input_file);
+    msh2exo::write_mesh(imesh, options.output_file, options, buffers);
+  }
+
+  if (options.fields) {
+    msh2exo::write_gmsh_fields(options.input_file, imesh, options.output_file,
+                               options);
+  }
+}
+
+// imesh and buffers are reused across conversions in watch mode, so their
+// capacity stays allocated between runs
+static void convert(msh2exo::Options &options,
+                    msh2exo::IntermediateMesh &imesh,
+                    msh2exo::writer_buffers &buffers) {
+  msh2exo::progress_reset();
+  msh2exo::progress_reporter reporter(options.progress, options.status_file);
+  try {
+    run_stages(options, imesh, buffers);
+  } catch (...) {
+    msh2exo::progress_stage("failed", 0, "");
+    throw;
   }
+  msh2exo::progress_stage("done", 0, "");
+}
+
+struct file_state {
+  bool exists = false;
+  int64_t mtime_ns = 0;
+  int64_t size = 0;
+
+  bool operator==(const file_state &other) const {
+    return exists == other.exists && mtime_ns == other.mtime_ns &&
+           size == other.size;
+  }
+  bool operator!=(const file_state &other) const { return !(*this == other); }
+};
+
+static file_state stat_file(const std::string &path) {
+  file_state state;
+  struct stat info;
+  if (stat(path.c_str(), &info) == 0) {
+    state.exists = true;
+#if defined(__APPLE__)
+    state.mtime_ns = static_cast<int64_t>(info.st_mtimespec.tv_sec) *
+                         1000000000 +
+                     info.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    state.mtime_ns = static_cast<int64_t>(info.st_mtime) * 1000000000;
 #else
-  imesh = msh2exo::read_gmsh_file(options.input_file);
+    state.mtime_ns = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 +
+                     info.st_mtim.tv_nsec;
 #endif
-  msh2exo::write_mesh(imesh, options.output_file, options);
+    state.size = info.st_size;
+  }
+  return state;
+}
+
+static void watch(msh2exo::Options &options, msh2exo::IntermediateMesh &imesh,
+                  msh2exo::writer_buffers &buffers) {
+  const auto poll_interval = std::chrono::milliseconds(200);
+  file_state converted;
+  fmt::print("{}: watching for changes, interrupt to stop\n",
+             options.input_file);
+  std::fflush(stdout);
+  while (true) {
+    auto state = stat_file(options.input_file);
+    if (!state.exists || state == converted) {
+      std::this_thread::sleep_for(poll_interval);
+      continue;
+    }
+    // mesh generators write the file over time, wait until it settles
+    std::this_thread::sleep_for(poll_interval);
+    if (stat_file(options.input_file) != state) {
+      continue;
+    }
+    converted = state;
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+      convert(options, imesh, buffers);
+      std::chrono::duration<double> elapsed =
+          std::chrono::steady_clock::now() - start;
+      fmt::print("{}: wrote {} in {:.3f} s\n", options.input_file,
+                 options.output_file, elapsed.count());
+      std::fflush(stdout);
+    } catch (const std::exception &e) {
+      // a half written or broken mesh should not end the session
+      fmt::print(stderr, "{}\n", e.what());
+    }
+  }
+}
+
+static std::string json_string(const std::string &value) {
+  std::string quoted = "\"";
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < ' ') {
+      quoted += fmt::format("\\u{:04x}", static_cast<int>(c));
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+// groups of the block dimension become element blocks, the lower ones node
+// and side sets, as in the conversion
+static void print_mesh_info(const msh2exo::Options &options) {
+  MSH2EXO_CHECK(msh2exo::is_stream_input(options.input_file) ||
+                    !msh2exo::is_snapshot_file(options.input_file),
+                fmt::format("{}: --info needs a msh file as input",
+                            options.input_file));
+  auto info = msh2exo::read_gmsh_info(options.input_file);
+
+  int n_blocks = 0;
+  int64_t n_block_elements = 0;
+  std::string groups;
+  for (const auto &physical : info.physicals) {
+    bool block = physical.dim == info.dim;
+    if (block) {
+      n_blocks++;
+      n_block_elements += physical.n_elements;
+    }
+    groups += fmt::format(
+        "{}\n    {{\"name\": {}, \"tag\": {}, \"dim\": {}, \"kind\": "
+        "\"{}\", \"n_elements\": {}, \"n_nodes_per_element\": {}}}",
+        groups.empty() ? "" : ",", json_string(physical.name), physical.tag,
+        physical.dim, block ? "block" : "boundary", physical.n_elements,
+        physical.n_nodes_per_element);
+  }
+  fmt::print("{{\n  \"file\": {},\n  \"version\": {},\n  \"dim\": {},\n"
+             "  \"n_nodes\": {},\n  \"n_elements\": {},\n"
+             "  \"n_elements_in_file\": {},\n  \"n_blocks\": {},\n"
+             "  \"n_boundaries\": {},\n  \"estimated_peak_bytes\": {},\n"
+             "  \"physical_groups\": [{}\n  ]\n}}\n",
+             json_string(options.input_file), info.version, info.dim,
+             info.n_nodes, n_block_elements, info.n_elements, n_blocks,
+             info.physicals.size() - n_blocks, info.estimated_peak_bytes,
+             groups);
+}
+
+void msh2exo::run_msh2exo(msh2exo::Options &options) {
+  MSH2EXO_CHECK(!options.input_file.empty(), "an input file is needed");
+  msh2exo::set_thread_count(options.threads);
+  if (options.info) {
+    print_mesh_info(options);
+    return;
+  }
+  MSH2EXO_CHECK(!options.output_file.empty(),
+                "an output file is needed unless --info is given");
+
+  IntermediateMesh imesh;
+  writer_buffers buffers;
+  if (options.watch) {
+    MSH2EXO_CHECK(!msh2exo::is_stream_input(options.input_file),
+                  fmt::format("{}: --watch needs a file as input",
+                              options.input_file));
+    watch(options, imesh, buffers);
+  } else {
+    convert(options, imesh, buffers);
+  }
 }
@@ -5,7 +5,8 @@
 // See the LICENSE file for license information.
 
 #pragma once
-#include "CLI/App.hpp"
+#include <string>
+#include <vector>
 
 namespace msh2exo {
 struct Options {
@@ -15,10 +16,29 @@ struct Options {
   bool builtin = false;
   bool verbose = false;
   bool version = false;
+  std::string cache_dir;
+  std::string snapshot_file;
+  double merge_tolerance = 0;
+  int refine = 0;
+  int order = 1;
+  // layers and height, empty unless extruding
+  std::vector<double> extrude;
+  // empty unless given, scale holds one factor for all axes or one per axis
+  std::vector<double> scale;
+  std::vector<double> translate;
+  std::vector<double> rotate;
+  int threads = 0;
+  bool check = false;
+  bool fix_orientation = false;
+  bool skin = false;
+  bool interfaces = false;
+  bool fields = false;
+  bool watch = false;
+  bool info = false;
+  bool progress = false;
+  std::string status_file;
 };
 
-void setup_options(CLI::App &app, Options &options);
-
 void run_msh2exo(Options &options);
 
 } // namespace msh2exo
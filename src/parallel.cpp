@@ -0,0 +1,23 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <atomic>
+
+#include "parallel.hpp"
+
+static std::atomic<int> requested_threads(0);
+
+void msh2exo::set_thread_count(int n_threads) {
+  requested_threads = std::max(n_threads, 0);
+}
+
+int msh2exo::thread_count() {
+  int n_threads = requested_threads;
+  if (n_threads == 0) {
+    n_threads = static_cast<int>(std::thread::hardware_concurrency());
+  }
+  return std::max(n_threads, 1);
+}
@@ -0,0 +1,77 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace msh2exo {
+// threads used by the parallel mesh stages, 0 selects the hardware
+// concurrency
+void set_thread_count(int n_threads);
+int thread_count();
+
+// Calls func(chunk_begin, chunk_end, thread) for contiguous chunks of
+// [begin, end), one chunk per thread. The first exception thrown by any
+// chunk is rethrown on the calling thread once all chunks finished. Ranges
+// shorter than two min_chunk run on the calling thread, small ranges of
+// expensive items (boundaries, partitions) pass a min_chunk of 1.
+template <typename F>
+void parallel_for_chunks(int64_t begin, int64_t end, F &&func,
+                         int64_t min_chunk = 4096) {
+  int64_t count = end - begin;
+  int n_threads = static_cast<int>(std::max<int64_t>(
+      1, std::min<int64_t>(thread_count(), count / min_chunk)));
+  if (n_threads == 1) {
+    if (count > 0) {
+      func(begin, end, 0);
+    }
+    return;
+  }
+
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  std::vector<std::thread> threads;
+  threads.reserve(n_threads - 1);
+  auto run = [&](int thread) {
+    int64_t chunk_begin = begin + count * thread / n_threads;
+    int64_t chunk_end = begin + count * (thread + 1) / n_threads;
+    try {
+      func(chunk_begin, chunk_end, thread);
+    } catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  };
+  for (int thread = 1; thread < n_threads; thread++) {
+    threads.emplace_back(run, thread);
+  }
+  run(0);
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+// func(i) for every i in [begin, end)
+template <typename F> void parallel_for(int64_t begin, int64_t end, F &&func) {
+  parallel_for_chunks(begin, end, [&func](int64_t chunk_begin,
+                                          int64_t chunk_end, int) {
+    for (int64_t i = chunk_begin; i < chunk_end; i++) {
+      func(i);
+    }
+  });
+}
+} // namespace msh2exo
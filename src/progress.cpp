@@ -0,0 +1,188 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "progress.hpp"
+#include "util.hpp"
+
+msh2exo::progress_counters msh2exo::progress;
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static bool stderr_is_terminal() {
+#ifdef _WIN32
+  return _isatty(_fileno(stderr));
+#else
+  return isatty(fileno(stderr));
+#endif
+}
+
+// 1234567 -> "1.23M"
+static std::string human(double value) {
+  const char *suffix[] = {"", "k", "M", "G", "T"};
+  int i = 0;
+  while (value >= 1000 && i < 4) {
+    value /= 1000;
+    i++;
+  }
+  return i == 0 ? fmt::format("{:.0f}", value)
+                : fmt::format("{:.2f}{}", value, suffix[i]);
+}
+
+void msh2exo::progress_reset() {
+  progress_stage("starting", 0, "");
+  progress.bytes_read = 0;
+  progress.nodes_read = 0;
+  progress.elements_read = 0;
+  progress.elements_remapped = 0;
+  progress.elements_searched = 0;
+  progress.elements_written = 0;
+}
+
+void msh2exo::progress_stage(const char *stage, int64_t total,
+                             const char *unit) {
+  progress.done.store(0, std::memory_order_relaxed);
+  progress.total.store(total, std::memory_order_relaxed);
+  progress.unit.store(unit, std::memory_order_relaxed);
+  progress.stage_start_ns.store(now_ns(), std::memory_order_relaxed);
+  progress.stage.store(stage, std::memory_order_release);
+}
+
+msh2exo::progress_reporter::progress_reporter(bool print,
+                                              std::string status_file,
+                                              double interval_seconds)
+    : print_(print), in_place_(print && stderr_is_terminal()),
+      status_file_(std::move(status_file)), interval_(interval_seconds),
+      start_ns_(now_ns()) {
+  if (!print_ && status_file_.empty()) {
+    return;
+  }
+  // fails early on an unwritable status file
+  sample(false);
+  thread_ = std::thread(&progress_reporter::run, this);
+}
+
+msh2exo::progress_reporter::~progress_reporter() {
+  if (!thread_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  thread_.join();
+  try {
+    sample(true);
+  } catch (const std::exception &) {
+  }
+}
+
+void msh2exo::progress_reporter::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto interval = std::chrono::duration<double>(interval_);
+  while (!wake_.wait_for(lock, interval, [this] { return stop_; })) {
+    try {
+      sample(false);
+    } catch (const std::exception &) {
+      // a status file that became unwritable should not end the conversion
+    }
+  }
+}
+
+void msh2exo::progress_reporter::sample(bool finished) {
+  const char *stage = progress.stage.load(std::memory_order_acquire);
+  const char *unit = progress.unit.load(std::memory_order_relaxed);
+  int64_t done = progress.done.load(std::memory_order_relaxed);
+  int64_t total = progress.total.load(std::memory_order_relaxed);
+  int64_t now = now_ns();
+  double elapsed = (now - start_ns_) * 1e-9;
+  double stage_elapsed =
+      (now - progress.stage_start_ns.load(std::memory_order_relaxed)) * 1e-9;
+
+  double rate = stage_elapsed > 0 ? done / stage_elapsed : 0;
+  double fraction = total > 0 ? std::min(1.0, 1.0 * done / total) : -1;
+  double eta =
+      rate > 0 && total > 0 ? std::max<int64_t>(0, total - done) / rate : -1;
+
+  int64_t bytes_read = progress.bytes_read.load(std::memory_order_relaxed);
+  int64_t nodes_read = progress.nodes_read.load(std::memory_order_relaxed);
+  int64_t elements_read =
+      progress.elements_read.load(std::memory_order_relaxed);
+  int64_t elements_remapped =
+      progress.elements_remapped.load(std::memory_order_relaxed);
+  int64_t elements_searched =
+      progress.elements_searched.load(std::memory_order_relaxed);
+  int64_t elements_written =
+      progress.elements_written.load(std::memory_order_relaxed);
+
+  if (print_) {
+    std::string line = fmt::format("[{:7.1f}s] {}", elapsed, stage);
+    if (fraction >= 0) {
+      line += fmt::format(" {:5.1f}%", 100 * fraction);
+    }
+    if (done > 0) {
+      // 1.2MB/s, 3.4M nodes/s
+      line += std::strcmp(unit, "B") == 0
+                  ? fmt::format(", {}B/s", human(rate))
+                  : fmt::format(", {} {}/s", human(rate), unit);
+    }
+    if (eta >= 0) {
+      line += fmt::format(", ETA {:.0f}s", eta);
+    }
+    line += fmt::format(" | read {}B, {} nodes, {} elements", human(bytes_read),
+                        human(nodes_read), human(elements_read));
+    if (in_place_) {
+      // pad over the rest of the previous line
+      fmt::print(stderr, "\r{:<100}{}", line, finished ? "\n" : "");
+    } else {
+      fmt::print(stderr, "{}\n", line);
+    }
+    std::fflush(stderr);
+  }
+
+  if (!status_file_.empty()) {
+    auto json = fmt::format(
+        "{{\"stage\": \"{}\", \"finished\": {}, \"elapsed\": {:.3f}, "
+        "\"done\": {}, \"total\": {}, \"unit\": \"{}\", \"rate\": {:.1f}, "
+        "\"eta\": {:.1f}, \"bytes_read\": {}, \"nodes_read\": {}, "
+        "\"elements_read\": {}, \"elements_remapped\": {}, "
+        "\"elements_searched\": {}, \"elements_written\": {}}}\n",
+        stage, finished ? "true" : "false", elapsed, done, total, unit, rate,
+        eta, bytes_read, nodes_read, elements_read, elements_remapped,
+        elements_searched, elements_written);
+    auto tmp_file = status_file_ + ".tmp";
+    {
+      std::ofstream out(tmp_file, std::ios::trunc);
+      out << json;
+      MSH2EXO_WRITE_CHECK(
+          out.good(), fmt::format("could not write status file {}", tmp_file));
+    }
+#ifdef _WIN32
+    // rename does not replace existing files on Windows
+    std::remove(status_file_.c_str());
+#endif
+    MSH2EXO_WRITE_CHECK(
+        std::rename(tmp_file.c_str(), status_file_.c_str()) == 0,
+        fmt::format("could not rename status file to {}", status_file_));
+  }
+}
@@ -0,0 +1,80 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace msh2exo {
+// Counters of the running conversion, sampled by a progress_reporter. The
+// stages update them with relaxed atomics once per chunk (tens of
+// thousands of nodes or elements, an entity block, a boundary), never per
+// item, so they cost nothing measurable when nobody is watching.
+struct progress_counters {
+  // current stage, its work done and total work (0 when unknown)
+  std::atomic<const char *> stage{"starting"};
+  std::atomic<const char *> unit{""};
+  std::atomic<int64_t> done{0};
+  std::atomic<int64_t> total{0};
+  std::atomic<int64_t> stage_start_ns{0};
+
+  std::atomic<int64_t> bytes_read{0};
+  std::atomic<int64_t> nodes_read{0};
+  std::atomic<int64_t> elements_read{0};
+  std::atomic<int64_t> elements_remapped{0};
+  std::atomic<int64_t> elements_searched{0};
+  std::atomic<int64_t> elements_written{0};
+};
+
+extern progress_counters progress;
+
+// items between counter updates in the per-item loops
+const int64_t progress_chunk = 65536;
+
+// zeroes all counters before a conversion
+void progress_reset();
+
+// starts a stage of total work units (0 when unknown), unit names them in
+// the report
+void progress_stage(const char *stage, int64_t total, const char *unit);
+
+inline void progress_add(std::atomic<int64_t> &counter, int64_t n) {
+  counter.fetch_add(n, std::memory_order_relaxed);
+}
+
+// Samples the progress counters on a background thread every interval,
+// printing the stage, rate and ETA to stderr and/or writing them as JSON
+// to status_file (replaced atomically, so readers never see a partial
+// file). The last sample is taken when the reporter is destroyed.
+class progress_reporter {
+public:
+  progress_reporter(bool print, std::string status_file,
+                    double interval_seconds = 1.0);
+  ~progress_reporter();
+
+  progress_reporter(const progress_reporter &) = delete;
+  progress_reporter &operator=(const progress_reporter &) = delete;
+
+private:
+  void run();
+  void sample(bool finished);
+
+  bool print_;
+  bool in_place_;
+  std::string status_file_;
+  double interval_;
+  int64_t start_ns_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_ = false;
+  std::thread thread_;
+};
+} // namespace msh2exo
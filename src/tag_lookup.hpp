@@ -0,0 +1,64 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace msh2exo {
+// Gmsh tag to mesh index, the inverse of IntermediateMesh::node_tags and
+// elem_tags. Gmsh numbers nodes and elements nearly contiguously, so the
+// table is a plain array indexed by tag whenever the largest tag is within
+// a small multiple of the count, and a hash map only for scattered tags. A
+// lookup is then one load instead of the tree walk of a std::map. Repeated
+// tags keep their first index.
+class tag_lookup {
+public:
+  tag_lookup() = default;
+
+  template <typename Tags> explicit tag_lookup(const Tags &tags) {
+    int64_t min_tag = 0;
+    int64_t max_tag = 0;
+    for (auto tag : tags) {
+      min_tag = std::min(min_tag, static_cast<int64_t>(tag));
+      max_tag = std::max(max_tag, static_cast<int64_t>(tag));
+    }
+    int64_t index = 0;
+    if (min_tag >= 0 &&
+        max_tag <= 2 * static_cast<int64_t>(tags.size()) + 1024) {
+      dense_.assign(max_tag + 1, -1);
+      for (auto tag : tags) {
+        auto &slot = dense_[static_cast<int64_t>(tag)];
+        if (slot < 0) {
+          slot = index;
+        }
+        index++;
+      }
+    } else {
+      for (auto tag : tags) {
+        sparse_.insert({static_cast<int64_t>(tag), index++});
+      }
+    }
+  }
+
+  // -1 for tags not in the mesh
+  int64_t find(int64_t tag) const {
+    if (!dense_.empty()) {
+      return tag >= 0 && tag < static_cast<int64_t>(dense_.size()) ? dense_[tag]
+                                                                   : -1;
+    }
+    auto it = sparse_.find(tag);
+    return it != sparse_.end() ? it->second : -1;
+  }
+
+private:
+  std::vector<int64_t> dense_;
+  std::unordered_map<int64_t, int64_t> sparse_;
+};
+} // namespace msh2exo
@@ -0,0 +1,117 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#include <algorithm>
+#include <cstring>
+#include <fmt/format.h>
+
+#include "text_scanner.hpp"
+#include "util.hpp"
+
+msh2exo::text_scanner::text_scanner(std::streambuf *source,
+                                    size_t buffer_size)
+    : source_(source), storage_(std::max(buffer_size, 2 * max_token)) {
+  buf_ = storage_.data();
+}
+
+msh2exo::text_scanner::text_scanner(const char *data, size_t size)
+    : buf_(data), end_(size), eof_(true) {}
+
+void msh2exo::text_scanner::refill() {
+  if (source_ == nullptr) {
+    eof_ = true;
+    return;
+  }
+  size_t remaining = end_ - pos_;
+  if (pos_ > 0) {
+    consumed_lines_ += std::count(buf_, buf_ + pos_, '\n');
+    std::memmove(storage_.data(), storage_.data() + pos_, remaining);
+    consumed_ += pos_;
+    pos_ = 0;
+    end_ = remaining;
+  }
+  if (end_ == storage_.size()) {
+    storage_.resize(storage_.size() * 2);
+  }
+  auto count = source_->sgetn(storage_.data() + end_, storage_.size() - end_);
+  if (count <= 0) {
+    eof_ = true;
+  } else {
+    end_ += count;
+  }
+  buf_ = storage_.data();
+}
+
+bool msh2exo::text_scanner::next_line(std::string &line) {
+  for (;;) {
+    const char *begin = buf_ + pos_;
+    auto newline = static_cast<const char *>(
+        std::memchr(begin, '\n', end_ - pos_));
+    if (newline != nullptr || eof_) {
+      if (newline == nullptr && pos_ == end_) {
+        return false;
+      }
+      const char *line_end = newline != nullptr ? newline : buf_ + end_;
+      pos_ = (newline != nullptr ? newline + 1 : line_end) - buf_;
+      if (line_end != begin && line_end[-1] == '\r') {
+        line_end--;
+      }
+      line.assign(begin, line_end);
+      return true;
+    }
+    refill();
+  }
+}
+
+msh2exo::text_scanner &msh2exo::text_scanner::operator>>(std::string &value) {
+  for (;;) {
+    const char *p = token_begin();
+    const char *last = p;
+    while (last != buf_ + end_ && static_cast<unsigned char>(*last) > ' ') {
+      last++;
+    }
+    // words are not limited to max_token, keep reading until the end
+    if (last == buf_ + end_ && !eof_) {
+      refill();
+      continue;
+    }
+    value.assign(p, last);
+    pos_ = last - buf_;
+    return *this;
+  }
+}
+
+bool msh2exo::text_scanner::skip_lines(uint64_t n) {
+  while (n > 0) {
+    auto newline = static_cast<const char *>(
+        std::memchr(buf_ + pos_, '\n', end_ - pos_));
+    if (newline != nullptr) {
+      pos_ = newline + 1 - buf_;
+      n--;
+      continue;
+    }
+    if (eof_) {
+      return false;
+    }
+    // nothing in the buffer is needed any more
+    pos_ = end_;
+    refill();
+  }
+  return true;
+}
+
+uint64_t msh2exo::text_scanner::line() const {
+  return consumed_lines_ + std::count(buf_, buf_ + pos_, '\n') + 1;
+}
+
+std::string msh2exo::text_scanner::location() const {
+  return fmt::format("byte offset {} (line {})", offset(), line());
+}
+
+void msh2exo::text_scanner::fail(const std::string &what) const {
+  throw read_error(
+      fmt::format("Error: gmsh reader: {} at {}", what, location()));
+}
@@ -0,0 +1,122 @@
+// msh2exo is distributed under the terms of the GNU General Public License
+//
+// Copyright (C) 2022 Weston Ortiz
+//
+// See the LICENSE file for license information.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "number_parser.hpp"
+
+namespace msh2exo {
+// Buffered, forward only tokenizer for msh text
+//
+// Reads from a std::streambuf in large chunks (or directly from memory) and
+// converts whitespace separated tokens with the kernels in
+// number_parser.hpp. Used like an std::istream through operator>>, but a
+// token that is not a valid number throws read_error instead of silently
+// setting failbit.
+class text_scanner {
+public:
+  explicit text_scanner(std::streambuf *source, size_t buffer_size = 1 << 20);
+  text_scanner(const char *data, size_t size);
+
+  text_scanner(const text_scanner &) = delete;
+  text_scanner &operator=(const text_scanner &) = delete;
+
+  // remainder of the current line without the line terminator
+  bool next_line(std::string &line);
+
+  text_scanner &operator>>(double &value) {
+    const char *p = token_begin();
+    check_token(parse_double(p, buf_ + end_, value), "floating point number");
+    return *this;
+  }
+
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value, text_scanner &>::type
+  operator>>(T &value) {
+    const char *p = token_begin();
+    const char *last;
+    if (std::is_signed<T>::value) {
+      int64_t val = 0;
+      last = parse_int(p, buf_ + end_, val);
+      if (val < static_cast<int64_t>(std::numeric_limits<T>::min()) ||
+          val > static_cast<int64_t>(std::numeric_limits<T>::max())) {
+        last = nullptr;
+      }
+      value = static_cast<T>(val);
+    } else {
+      uint64_t val = 0;
+      last = parse_uint(p, buf_ + end_, val);
+      if (val > static_cast<uint64_t>(std::numeric_limits<T>::max())) {
+        last = nullptr;
+      }
+      value = static_cast<T>(val);
+    }
+    check_token(last, "integer");
+    return *this;
+  }
+
+  text_scanner &operator>>(std::string &value);
+
+  // skips the rest of the current line and n - 1 lines after it, only
+  // searching for line ends, false if the input ends first
+  bool skip_lines(uint64_t n);
+
+  // byte offset of the next unread character
+  uint64_t offset() const { return consumed_ + pos_; }
+  // 1-based line of the next unread character
+  uint64_t line() const;
+  // "byte offset N (line L)" of the next unread character, for messages
+  std::string location() const;
+
+private:
+  // longest token that is guaranteed to be contiguous in the buffer
+  static const size_t max_token = 256;
+
+  const char *token_begin() {
+    for (;;) {
+      const char *p = skip_whitespace(buf_ + pos_, buf_ + end_);
+      pos_ = p - buf_;
+      if (end_ - pos_ >= max_token || eof_) {
+        if (pos_ == end_) {
+          fail("unexpected end of input");
+        }
+        return p;
+      }
+      refill();
+    }
+  }
+
+  void check_token(const char *last, const char *expected) {
+    if (last == nullptr ||
+        (last == buf_ + end_ ? !eof_
+                             : static_cast<unsigned char>(*last) > ' ')) {
+      fail(std::string("expected ") + expected);
+    }
+    pos_ = last - buf_;
+  }
+
+  void refill();
+  [[noreturn]] void fail(const std::string &what) const;
+
+  std::streambuf *source_ = nullptr;
+  std::vector<char> storage_;
+  const char *buf_ = nullptr;
+  size_t pos_ = 0;
+  size_t end_ = 0;
+  uint64_t consumed_ = 0;
+  // line ends in the consumed bytes, counted as the buffer moves on
+  uint64_t consumed_lines_ = 0;
+  bool eof_ = false;
+};
+} // namespace msh2exo
@@ -7,29 +7,12 @@
 #include <fmt/printf.h>
 
 #include "util.hpp"
-#ifndef ENABLE_SOURCE_LOCATION
-void msh2exo::failure_check_func(bool status, const std::string &msg,
-                                 size_t line, std::string file) {
-  if (!status) {
-    std::string errmsg = fmt::format("Error: {} at {}:{}", msg, file, line);
-    throw std::runtime_error(errmsg);
-  }
-}
 
-#else
-void msh2exo::failure_check_func(
-    bool status, const std::string &msg,
-    const std::experimental::source_location &location) {
-  if (!status) {
-    std::string errmsg =
-        fmt::format("Error: {} at {}:{} in {}", msg, location.file_name(),
-                    location.line(), location.function_name());
-    throw std::runtime_error(errmsg);
-  }
-}
+#ifndef _WIN32
+#include <sys/resource.h>
 #endif
 
-void msh2exo::print_info_and_exit(void) {
+void msh2exo::print_info(void) {
   const auto format_string =
       "msh2exo version {}\n\n"
       "msh2exo is distributed under the terms of the GNU General "
@@ -38,6 +21,20 @@ void msh2exo::print_info_and_exit(void) {
       "See the LICENSE file for license information.\n";
 
   fmt::print(format_string, MSH2EXO_VERSION);
+}
 
-  std::exit(1);
+size_t msh2exo::peak_rss_bytes() {
+#ifndef _WIN32
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return 0;
+#endif
 }
@@ -7,37 +7,87 @@
 #pragma once
 
 #include <fmt/core.h>
+#include <fmt/format.h>
 #include <fmt/ostream.h>
+#include <stdexcept>
 #include <string>
 
 #include "config.hpp"
-#ifndef ENABLE_SOURCE_LOCATION
 
-#define MSH2EXO_CHECK(status, msg)                                             \
-  msh2exo::failure_check_func(status, msg, __LINE__, __FILE__)
+namespace msh2exo {
+// base class of every error raised by the readers, writer and conversion
+class error : public std::runtime_error {
+public:
+  using std::runtime_error::runtime_error;
+};
+
+// missing, malformed or unsupported mesh input
+class read_error : public error {
+public:
+  using error::error;
+};
+
+// failure creating or filling the ExodusII output
+class write_error : public error {
+public:
+  using error::error;
+};
+} // namespace msh2exo
+
+// The checks only evaluate msg when status is false, so messages built with
+// fmt::format cost nothing on the passing path and checks can stay on in
+// the readers' loops.
+#ifndef ENABLE_SOURCE_LOCATION
 
-#define MSH2EXO_ERROR(msg)                                                     \
-  msh2exo::failure_check_func(false, msg, __LINE__, __FILE__)
+#define MSH2EXO_CHECK_AS(E, status, msg)                                       \
+  do {                                                                         \
+    if (!(status)) {                                                           \
+      msh2exo::throw_failure<E>(msg, __LINE__, __FILE__);                      \
+    }                                                                          \
+  } while (false)
 
 namespace msh2exo {
-void failure_check_func(bool status, const std::string &msg, size_t line,
-                        std::string file);
+template <typename E>
+[[noreturn]] void throw_failure(const std::string &msg, size_t line,
+                                const char *file) {
+  throw E(fmt::format("Error: {} at {}:{}", msg, file, line));
 }
+} // namespace msh2exo
 #else
 #include <experimental/source_location>
 
-#define MSH2EXO_CHECK msh2exo::failure_check_func
+#define MSH2EXO_CHECK_AS(E, status, msg)                                       \
+  do {                                                                         \
+    if (!(status)) {                                                           \
+      msh2exo::throw_failure<E>(msg);                                          \
+    }                                                                          \
+  } while (false)
 
 namespace msh2exo {
-
-void failure_check_func(bool status, const std::string &msg,
-                        const std::experimental::source_location &location =
-                            std::experimental::source_location::current());
+template <typename E>
+[[noreturn]] void
+throw_failure(const std::string &msg,
+              const std::experimental::source_location &location =
+                  std::experimental::source_location::current()) {
+  throw E(fmt::format("Error: {} at {}:{} in {}", msg, location.file_name(),
+                      location.line(), location.function_name()));
 }
+} // namespace msh2exo
 #endif
 
+#define MSH2EXO_CHECK(status, msg)                                             \
+  MSH2EXO_CHECK_AS(msh2exo::error, status, msg)
+#define MSH2EXO_READ_CHECK(status, msg)                                        \
+  MSH2EXO_CHECK_AS(msh2exo::read_error, status, msg)
+#define MSH2EXO_WRITE_CHECK(status, msg)                                       \
+  MSH2EXO_CHECK_AS(msh2exo::write_error, status, msg)
+#define MSH2EXO_ERROR(msg) MSH2EXO_CHECK_AS(msh2exo::error, false, msg)
+
 namespace msh2exo {
-void print_info_and_exit(void);
+void print_info(void);
+
+// high water mark of the resident set size of the process, 0 if unknown
+size_t peak_rss_bytes();
 
 template <typename S, typename... Args>
 void print_if(bool flag, const S &format, Args &&...args) {